@@ -5,6 +5,17 @@
 #include <map>
 #include <fstream>
 #include <sstream>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <climits>
+#include <cstdlib>
+#include <cmath>
+#include "edge_loader.h"
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 using namespace std::chrono;
@@ -43,12 +54,18 @@ public:
         }
     }
     
-    // Find with path compression
+    // Find with path compression (iterative, so long chains can't overflow the stack)
     int find(int x) {
-        if (parent[x] != x) {
-            parent[x] = find(parent[x]);  // path compression
+        int root = x;
+        while (parent[root] != root) {
+            root = parent[root];
         }
-        return parent[x];
+        while (parent[x] != root) {
+            int next = parent[x];
+            parent[x] = root;  // path compression
+            x = next;
+        }
+        return root;
     }
 
     // Union by rank
@@ -77,98 +94,1220 @@ public:
     int getComponents() {
         return components;
     }
+
+    int size() {
+        return (int)parent.size();
+    }
+
+    // Add a new singleton element and return its index
+    int addElement() {
+        parent.push_back((int)parent.size());
+        rank.push_back(0);
+        components++;
+        return (int)parent.size() - 1;
+    }
     
     bool connected(int x, int y) {
         return find(x) == find(y);
     }
 };
 
-int main() {
-    vector<Edge> edges;
+// Union-Find that many threads can use at once without locks. Each element
+// is one 64-bit atomic word holding its rank (high half) and parent (low
+// half), so a root can be linked with a single compare-and-swap that also
+// checks the rank has not changed. Roots are linked by (rank, index) so two
+// threads can never link two roots under each other. find() is iterative
+// and uses path halving, which is also just a CAS on the child's word.
+class ConcurrentUnionFind {
+private:
+    vector<atomic<uint64_t> > words;
+    atomic<int> components;
 
-    // Read input from file
-    ifstream inputFile("B1_input.txt");
-    if (!inputFile.is_open()) {
-        cout << "Error: Could not open B1_input.txt" << endl;
-        return 1;
+    static uint64_t pack(uint32_t rank, uint32_t parent) {
+        return ((uint64_t)rank << 32) | parent;
+    }
+    static uint32_t parentOf(uint64_t word) { return (uint32_t)word; }
+    static uint32_t rankOf(uint64_t word) { return (uint32_t)(word >> 32); }
+
+public:
+    ConcurrentUnionFind(int n) : words(n) {
+        for (int i = 0; i < n; i++) {
+            words[i].store(pack(0, i));
+        }
+        components.store(n);
+    }
+
+    int find(int x) {
+        while (true) {
+            uint64_t w = words[x].load();
+            uint32_t p = parentOf(w);
+            if (p == (uint32_t)x) return x;
+
+            uint32_t gp = parentOf(words[p].load());
+            if (gp != p) {
+                // Path halving: point x at its grandparent (fine if it fails)
+                words[x].compare_exchange_weak(w, pack(rankOf(w), gp));
+            }
+            x = gp;
+        }
+    }
+
+    bool unite(int x, int y) {
+        while (true) {
+            x = find(x);
+            y = find(y);
+            if (x == y) return false;
+
+            uint64_t wx = words[x].load();
+            uint64_t wy = words[y].load();
+            if (parentOf(wx) != (uint32_t)x || parentOf(wy) != (uint32_t)y) continue;  // no longer roots
+
+            // Link the smaller (rank, index) root under the larger one
+            if (rankOf(wx) < rankOf(wy) || (rankOf(wx) == rankOf(wy) && x < y)) {
+                swap(x, y);
+                swap(wx, wy);
+            }
+            if (!words[y].compare_exchange_strong(wy, pack(rankOf(wy), x))) continue;
+
+            if (rankOf(wx) == rankOf(wy)) {
+                // Best effort: if x changed meanwhile its rank is stale anyway
+                words[x].compare_exchange_strong(wx, pack(rankOf(wx) + 1, x));
+            }
+            components.fetch_sub(1);
+            return true;
+        }
+    }
+
+    bool connected(int x, int y) {
+        while (true) {
+            x = find(x);
+            y = find(y);
+            if (x == y) return true;
+            // Only trust a "no" if x is still a root (nothing was linked meanwhile)
+            if (parentOf(words[x].load()) == (uint32_t)x) return false;
+        }
+    }
+
+    int getComponents() {
+        return components.load();
+    }
+};
+
+// Unite every edge on a pool of threads, each taking one contiguous chunk
+void parallelUniteEdges(const vector<Edge>& edges, ConcurrentUnionFind& uf, int threads) {
+    auto work = [&](int t) {
+        int lo = (int)((long long)edges.size() * t / threads);
+        int hi = (int)((long long)edges.size() * (t + 1) / threads);
+        for (int i = lo; i < hi; i++) {
+            uf.unite(edges[i].u, edges[i].v);
+        }
+    };
+    vector<thread> pool;
+    for (int t = 1; t < threads; t++) pool.push_back(thread(work, t));
+    work(0);
+    for (int t = 0; t < (int)pool.size(); t++) pool[t].join();
+}
+
+// Hands out edges in descending similarity while only ordering the part of
+// the list that is actually consumed (Filter-Kruskal style incremental
+// quicksort). The pending part is a stack of unsorted ranges, heaviest on
+// top. A large range is first filtered - edges whose photos are already in
+// one group are dropped, since the merge loop would skip them anyway - and
+// then split three ways around a pivot. Small ranges are sorted and served.
+class FilterKruskalSource {
+private:
+    vector<Edge>& edges;  // reordered in place
+    UnionFind& uf;
+    vector<pair<int, int> > pending;  // unsorted [lo, hi) ranges
+    int cursor;
+    int readyEnd;                     // edges[cursor .. readyEnd-1] are sorted
+
+    static const int SMALL_RANGE = 64;
+
+    // Move edges that would close a cycle to the back of [lo, hi)
+    int filter(int lo, int hi) {
+        int keep = lo;
+        for (int i = lo; i < hi; i++) {
+            if (!uf.connected(edges[i].u, edges[i].v)) {
+                swap(edges[keep++], edges[i]);
+            }
+        }
+        return keep;
+    }
+
+    static int medianOfThree(int a, int b, int c) {
+        if (a < b) swap(a, b);
+        if (b < c) swap(b, c);
+        if (a < b) swap(a, b);
+        return b;
+    }
+
+public:
+    FilterKruskalSource(vector<Edge>& edges, UnionFind& uf) : edges(edges), uf(uf) {
+        cursor = 0;
+        readyEnd = 0;
+        if (!edges.empty()) pending.push_back(make_pair(0, (int)edges.size()));
+    }
+
+    bool next(Edge& out) {
+        while (cursor == readyEnd) {
+            if (pending.empty()) return false;
+            int lo = pending.back().first;
+            int hi = pending.back().second;
+            pending.pop_back();
+
+            if (hi - lo > SMALL_RANGE) {
+                hi = filter(lo, hi);
+            }
+            if (hi - lo <= SMALL_RANGE) {
+                sort(edges.begin() + lo, edges.begin() + hi, compareEdges);
+                cursor = lo;
+                readyEnd = hi;
+                break;
+            }
+
+            // Three-way partition: [heavier | equal to pivot | lighter]
+            int pivot = medianOfThree(edges[lo].weight, edges[lo + (hi - lo) / 2].weight, edges[hi - 1].weight);
+            int gt = lo, i = lo, lt = hi;
+            while (i < lt) {
+                if (edges[i].weight > pivot) swap(edges[gt++], edges[i++]);
+                else if (edges[i].weight < pivot) swap(edges[i], edges[--lt]);
+                else i++;
+            }
+            if (lo == gt && lt == hi) {
+                // Every weight equals the pivot, so the range is already in order
+                cursor = lo;
+                readyEnd = hi;
+                break;
+            }
+            if (lt < hi) pending.push_back(make_pair(lt, hi));
+            if (gt < lt) pending.push_back(make_pair(gt, lt));
+            if (lo < gt) pending.push_back(make_pair(lo, gt));
+        }
+        out = edges[cursor++];
+        return true;
+    }
+};
+
+// Stable counting sort, highest similarity first, for weights in [minW, maxW]
+void countingSortEdges(vector<Edge>& edges, int minW, int maxW) {
+    vector<int> start(maxW - minW + 2, 0);
+    for (int i = 0; i < (int)edges.size(); i++) {
+        start[maxW - edges[i].weight + 1]++;
+    }
+    for (int b = 1; b < (int)start.size(); b++) {
+        start[b] += start[b - 1];
+    }
+    vector<Edge> sorted(edges.size(), Edge(0, 0, 0));
+    for (int i = 0; i < (int)edges.size(); i++) {
+        sorted[start[maxW - edges[i].weight]++] = edges[i];
+    }
+    edges.swap(sorted);
+}
+
+// Key that sorts ascending in descending weight order (works for negatives)
+static inline unsigned descendingKey(int weight) {
+    return ~((unsigned)weight ^ 0x80000000u);
+}
+
+// Stable LSD radix sort on 32-bit weights, highest first, 8 bits per pass.
+// Each pass splits the edges into one chunk per thread: the threads count
+// their chunk's digits, the counts are turned into per-thread output
+// offsets, and the threads scatter their chunks in parallel. A pass is
+// skipped when every edge has the same digit.
+void radixSortEdges(vector<Edge>& edges, int threads) {
+    int m = (int)edges.size();
+    if (threads < 1) threads = 1;
+    if (threads > m / 65536 + 1) threads = m / 65536 + 1;
+
+    vector<Edge> buffer(m, Edge(0, 0, 0));
+    vector<Edge>* src = &edges;
+    vector<Edge>* dst = &buffer;
+    vector<vector<int> > counts(threads, vector<int>(256));
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        auto countChunk = [&](int t) {
+            vector<int>& c = counts[t];
+            fill(c.begin(), c.end(), 0);
+            int lo = (int)((long long)m * t / threads), hi = (int)((long long)m * (t + 1) / threads);
+            for (int i = lo; i < hi; i++) {
+                c[(descendingKey((*src)[i].weight) >> shift) & 0xFF]++;
+            }
+        };
+        auto scatterChunk = [&](int t) {
+            vector<int>& next = counts[t];
+            int lo = (int)((long long)m * t / threads), hi = (int)((long long)m * (t + 1) / threads);
+            for (int i = lo; i < hi; i++) {
+                (*dst)[next[(descendingKey((*src)[i].weight) >> shift) & 0xFF]++] = (*src)[i];
+            }
+        };
+
+        vector<thread> pool;
+        for (int t = 1; t < threads; t++) pool.push_back(thread(countChunk, t));
+        countChunk(0);
+        for (int t = 0; t < (int)pool.size(); t++) pool[t].join();
+
+        // Turn the counts into output offsets: digit-major, then thread order
+        int total = 0;
+        bool trivial = false;
+        for (int d = 0; d < 256; d++) {
+            int digitCount = 0;
+            for (int t = 0; t < threads; t++) {
+                int c = counts[t][d];
+                counts[t][d] = total;
+                total += c;
+                digitCount += c;
+            }
+            if (digitCount == m) trivial = true;
+        }
+        if (trivial) continue;
+
+        pool.clear();
+        for (int t = 1; t < threads; t++) pool.push_back(thread(scatterChunk, t));
+        scatterChunk(0);
+        for (int t = 0; t < (int)pool.size(); t++) pool[t].join();
+        swap(src, dst);
+    }
+
+    if (src != &edges) edges.swap(buffer);
+}
+
+// Sort by looking at the weight range first: counting sort for a narrow
+// range (like 0-100 similarity scores), radix sort for wide ranges on big
+// inputs, and the comparison sort for small inputs. Ties keep input order
+// for the first two. Returns a short description of what was used.
+string bucketSortEdges(vector<Edge>& edges) {
+    if (edges.empty()) return "nothing to sort";
+
+    int minW = INT_MAX, maxW = INT_MIN;
+    for (int i = 0; i < (int)edges.size(); i++) {
+        if (edges[i].weight < minW) minW = edges[i].weight;
+        if (edges[i].weight > maxW) maxW = edges[i].weight;
+    }
+
+    stringstream how;
+    if ((long long)maxW - minW < 65536) {
+        countingSortEdges(edges, minW, maxW);
+        how << "counting sort (weights " << minW << ".." << maxW << ")";
+    } else if (edges.size() >= 4096) {
+        int threads = thread::hardware_concurrency();
+        radixSortEdges(edges, threads);
+        how << "radix sort (weights " << minW << ".." << maxW << ", up to " << max(threads, 1) << " threads)";
+    } else {
+        sort(edges.begin(), edges.end(), compareEdges);
+        how << "comparison sort (weights " << minW << ".." << maxW << ")";
+    }
+    return how.str();
+}
+
+// How the edges are put in descending order before merging
+enum EdgeOrder {
+    FULL_SORT,       // comparison sort of the whole list
+    FILTER_KRUSKAL,  // lazy: only the consumed prefix gets ordered
+    BUCKET_SORT      // counting / radix sort picked from the weight range
+};
+
+// Merge the most similar photos until k groups remain. Returns the number
+// of merges; with verbose set, every merge is printed, and with mergeLog
+// set, every merged edge is appended to it in merge order.
+int clusterPhotos(vector<Edge>& edges, UnionFind& uf, int k, EdgeOrder order, bool verbose,
+                  vector<Edge>* mergeLog = NULL) {
+    int edgesProcessed = 0;
+    Edge edge(0, 0, 0);
+
+    if (order == FULL_SORT) {
+        sort(edges.begin(), edges.end(), compareEdges);
+    } else if (order == BUCKET_SORT) {
+        string how = bucketSortEdges(edges);
+        if (verbose) cout << "Ordering edges with " << how << endl;
+    }
+    if (verbose) cout << "Edges sorted by similarity (highest first)" << endl;
+    if (verbose) cout << "Starting with " << uf.getComponents() << " components (each photo is separate)" << endl << endl;
+
+    FilterKruskalSource lazy(edges, uf);
+    for (int i = 0; ; i++) {
+        if (uf.getComponents() <= k) {
+            if (verbose) cout << "Reached target of " << k << " groups, stopping..." << endl;
+            break;
+        }
+
+        if (order != FILTER_KRUSKAL) {
+            if (i >= (int)edges.size()) break;
+            edge = edges[i];
+        } else if (!lazy.next(edge)) {
+            break;
+        }
+
+        if (!uf.connected(edge.u, edge.v)) {
+            if (verbose) {
+                cout << "Merging p" << (edge.u + 1) << " and p" << (edge.v + 1)
+                     << " (similarity: " << edge.weight << ") -> ";
+            }
+            uf.unite(edge.u, edge.v);
+            edgesProcessed++;
+            if (mergeLog) mergeLog->push_back(edge);
+            if (verbose) cout << uf.getComponents() << " groups remaining" << endl;
+        }
+    }
+    return edgesProcessed;
+}
+
+// Full merge sequence of single-linkage clustering: the maximum spanning
+// forest edges in the order Kruskal merges them (most similar first).
+// Merging the first n-k entries gives the k groups, and merging every entry
+// with similarity >= t gives the groups for threshold t, so any k or
+// threshold is answered in O(n) without touching the edge list again.
+struct Dendrogram {
+    int numPhotos;
+    vector<Edge> merges;
+};
+
+// Replay the dendrogram into uf until k groups remain or the next merge is
+// less similar than minSimilarity. Returns the number of merges applied.
+int applyDendrogram(const Dendrogram& d, UnionFind& uf, int k, int minSimilarity) {
+    int applied = 0;
+    for (int i = 0; i < (int)d.merges.size() && uf.getComponents() > k; i++) {
+        if (d.merges[i].weight < minSimilarity) break;
+        uf.unite(d.merges[i].u, d.merges[i].v);
+        applied++;
+    }
+    return applied;
+}
+
+// Saved in the same "pA pB similarity" format as B1_input.txt, after a
+// "photos N" header line
+bool saveDendrogram(const Dendrogram& d, const string& fileName) {
+    ofstream out(fileName.c_str());
+    if (!out.is_open()) return false;
+    out << "photos " << d.numPhotos << endl;
+    for (int i = 0; i < (int)d.merges.size(); i++) {
+        out << "p" << (d.merges[i].u + 1) << " p" << (d.merges[i].v + 1) << " " << d.merges[i].weight << endl;
+    }
+    return true;
+}
+
+// Index of a photo name "pN" (N >= 1, digits only); false for anything else
+bool parsePhotoName(const string& name, int& index) {
+    if (name.size() < 2 || name[0] != 'p') return false;
+    long long number = 0;
+    for (size_t i = 1; i < name.size(); i++) {
+        if (name[i] < '0' || name[i] > '9') return false;
+        number = number * 10 + (name[i] - '0');
+        if (number > INT_MAX) return false;
+    }
+    if (number < 1) return false;
+    index = (int)(number - 1);
+    return true;
+}
+
+// False if the file is malformed or names a photo outside 1..numPhotos
+bool loadDendrogram(Dendrogram& d, const string& fileName) {
+    ifstream in(fileName.c_str());
+    if (!in.is_open()) return false;
+    string header;
+    if (!(in >> header >> d.numPhotos) || header != "photos" || d.numPhotos < 0) return false;
+    d.merges.clear();
+    string photo1, photo2;
+    int similarity;
+    while (in >> photo1 >> photo2 >> similarity) {
+        int u, v;
+        if (!parsePhotoName(photo1, u) || !parsePhotoName(photo2, v) || u >= d.numPhotos || v >= d.numPhotos) {
+            return false;
+        }
+        d.merges.push_back(Edge(u, v, similarity));
+    }
+    return in.eof();
+}
+
+// Largest photo number an edge file may use; n is sized from the ids, so
+// this bounds the Union-Find a single bad line can allocate
+const int MAX_PHOTOS = 1 << 24;
+
+// Edges of a "pA pB similarity" file. n grows to cover every photo named
+// (it is never lowered); false if the file cannot be read or names a photo
+// above MAX_PHOTOS.
+bool loadPhotoEdges(const string& fileName, vector<Edge>& edges, int& n) {
+    EdgeListFile inputFile;
+    if (!inputFile.load(fileName)) return false;
+
+    // Convert photo names like p1, p2 to indices 0, 1, etc
+    const vector<EdgeRecord>& records = inputFile.getEdges();
+    edges.reserve(records.size());
+    for (int i = 0; i < (int)records.size(); i++) {
+        int u = records[i].from.suffixNumber() - 1;
+        int v = records[i].to.suffixNumber() - 1;
+        if (u >= MAX_PHOTOS || v >= MAX_PHOTOS) return false;
+        if (u < 0 || v < 0) continue;  // no number, or too long to be a photo id
+        edges.push_back(Edge(u, v, records[i].weight));
+        n = max(n, max(u, v) + 1);
+    }
+    return true;
+}
+
+// Streaming single-linkage clustering. The k groups only depend on the
+// maximum spanning forest, so memory stays bounded by the photo count: the
+// forest itself plus a buffer of edges that closed a cycle when they
+// arrived. An edge joining two components is always a forest edge and is
+// taken at once; buffered edges are folded back in (Kruskal over forest +
+// buffer, which gives the same forest as Kruskal over every edge seen)
+// when the buffer outgrows the forest or a query needs the exact answer.
+// The sorted forest is a Dendrogram, so checkpoints use that file format.
+class IncrementalClusterer {
+private:
+    UnionFind components;   // connectivity over every edge seen so far
+    Dendrogram state;       // forest edges, most similar first once compacted
+    vector<Edge> pending;
+    bool sorted;
+
+    void compact() {
+        if (sorted && pending.empty()) return;
+        vector<Edge>& forest = state.merges;
+        forest.insert(forest.end(), pending.begin(), pending.end());
+        pending.clear();
+        stable_sort(forest.begin(), forest.end(), compareEdges);
+        UnionFind uf(numPhotos());
+        vector<Edge> kept;
+        kept.reserve(forest.size());
+        for (int i = 0; i < (int)forest.size(); i++) {
+            if (uf.unite(forest[i].u, forest[i].v)) kept.push_back(forest[i]);
+        }
+        forest.swap(kept);
+        sorted = true;
+    }
+
+public:
+    IncrementalClusterer(int n = 0) : components(n), sorted(true) {
+        state.numPhotos = n;
+    }
+
+    int numPhotos() {
+        return components.size();
+    }
+
+    int addPhoto() {
+        state.numPhotos++;
+        return components.addElement();
+    }
+
+    // u and v must already be photos (below numPhotos())
+    void addEdge(int u, int v, int weight) {
+        if (components.unite(u, v)) {
+            state.merges.push_back(Edge(u, v, weight));
+            sorted = false;
+        } else {
+            pending.push_back(Edge(u, v, weight));
+            if (pending.size() > max(state.merges.size(), (size_t)1024)) compact();
+        }
+    }
+
+    // Edges held in memory (forest + buffer)
+    size_t storedEdges() {
+        return state.merges.size() + pending.size();
+    }
+
+    // Current groups for k (and optionally a similarity threshold) in uf,
+    // which must be sized to numPhotos(). Returns the merges applied.
+    int groups(UnionFind& uf, int k, int minSimilarity = INT_MIN) {
+        compact();
+        return applyDendrogram(state, uf, k, minSimilarity);
+    }
+
+    bool checkpoint(const string& fileName) {
+        compact();
+        return saveDendrogram(state, fileName);
+    }
+
+    // Leaves the state untouched if the file is bad
+    bool restore(const string& fileName) {
+        Dendrogram loaded;
+        if (!loadDendrogram(loaded, fileName)) return false;
+        *this = IncrementalClusterer(loaded.numPhotos);
+        for (int i = 0; i < (int)loaded.merges.size(); i++) {
+            addEdge(loaded.merges[i].u, loaded.merges[i].v, loaded.merges[i].weight);
+        }
+        return true;
+    }
+};
+
+// Print the groups of uf over photos 0..n-1, in the B1_output.txt layout
+void printGroups(UnionFind& uf, int n, ostream& out) {
+    map<int, vector<int> > groups;
+    for (int i = 0; i < n; i++) {
+        groups[uf.find(i)].push_back(i + 1);  // +1 to convert back to photo numbers
+    }
+    int groupNum = 1;
+    for (map<int, vector<int> >::iterator it = groups.begin(); it != groups.end(); ++it) {
+        out << "Group " << groupNum << " = " << it->second.size() << "; photos: ";
+        for (int i = 0; i < (int)it->second.size(); i++) {
+            out << "p" << it->second[i];
+            if (i < (int)it->second.size() - 1) out << ", ";
+        }
+        out << endl;
+        groupNum++;
     }
+}
 
+// Service mode: seed from clusterer, then read commands from stdin.
+//   pA pB similarity    add an edge between existing photos
+//   photo               add a photo with no edges yet
+//   groups [K]          print the current K groups
+//   checkpoint [FILE]   save the state (defaults to checkpointFile)
+// With checkpointEvery > 0 the state is also saved every that many edges.
+void runStreamMode(IncrementalClusterer& clusterer, int k, const string& checkpointFile, int checkpointEvery) {
     string line;
-    while (getline(inputFile, line)) {
+    long long added = 0;
+    while (getline(cin, line)) {
         stringstream ss(line);
-        string photo1, photo2;
-        int similarity;
+        string command;
+        if (!(ss >> command)) continue;
+        if (command == "photo") {
+            cout << "p" << (clusterer.addPhoto() + 1) << endl;
+        } else if (command == "groups") {
+            int groupsWanted = k;
+            ss >> groupsWanted;
+            auto start = high_resolution_clock::now();
+            UnionFind uf(clusterer.numPhotos());
+            clusterer.groups(uf, groupsWanted);
+            auto end = high_resolution_clock::now();
+            printGroups(uf, clusterer.numPhotos(), cout);
+            cout << "Query-time: " << duration_cast<microseconds>(end - start).count() << " microseconds" << endl;
+        } else if (command == "checkpoint") {
+            string fileName = checkpointFile;
+            ss >> fileName;
+            if (fileName.empty() || !clusterer.checkpoint(fileName)) {
+                cout << "Error: Could not write checkpoint " << fileName << endl;
+            } else {
+                cout << "Checkpoint: " << clusterer.numPhotos() << " photos, " << fileName << endl;
+            }
+        } else if (command[0] == 'p' && command.size() > 1) {
+            string other;
+            int u, v, similarity;
+            if (!(ss >> other >> similarity) || !parsePhotoName(command, u) || !parsePhotoName(other, v)) {
+                cout << "Error: expected \"pA pB similarity\"" << endl;
+                continue;
+            }
+            if (u >= clusterer.numPhotos() || v >= clusterer.numPhotos()) {
+                cout << "Error: no such photo (there are " << clusterer.numPhotos() << "; add more with \"photo\")"
+                     << endl;
+                continue;
+            }
+            clusterer.addEdge(u, v, similarity);
+            added++;
+            if (checkpointEvery > 0 && added % checkpointEvery == 0 && !checkpointFile.empty()) {
+                clusterer.checkpoint(checkpointFile);
+            }
+        } else {
+            cout << "Error: unknown command " << command << endl;
+        }
+    }
+    if (!checkpointFile.empty()) clusterer.checkpoint(checkpointFile);
+    cout << "Stream closed: " << added << " edges added, " << clusterer.numPhotos() << " photos, "
+         << clusterer.storedEdges() << " edges kept" << endl;
+}
+
+// Edge preference for Borůvka packed into one word: higher similarity wins,
+// then the lower edge index, so every edge has a distinct rank and the
+// chosen edges can never form a cycle
+static inline uint64_t boruvkaKey(const Edge& e, int index) {
+    return ((uint64_t)((uint32_t)e.weight ^ 0x80000000u) << 32) | (uint32_t)~(uint32_t)index;
+}
+
+// Parallel Borůvka clustering. Every round, threads scan chunks of the
+// remaining edges and each group's best outgoing edge is kept with an
+// atomic max; the winners are then merged and edges inside a group are
+// dropped. The rounds build the maximum spanning forest, and Kruskal's
+// k-clustering is exactly that forest minus its lightest edges, so the
+// forest edges are finally merged heaviest first until k groups remain.
+// With no weight ties this gives the same groups (and the same merge
+// sequence) as clusterPhotos. Returns the number of merges.
+int boruvkaCluster(const vector<Edge>& edges, UnionFind& uf, int k, int threads, bool verbose,
+                   vector<Edge>* mergeLog = NULL) {
+    int n = (int)uf.getComponents();
+    if (threads < 1) threads = 1;
+
+    // Work on edge indices so ties can be broken by input position
+    vector<int> live;
+    for (int i = 0; i < (int)edges.size(); i++) {
+        if (edges[i].u != edges[i].v) live.push_back(i);
+    }
+
+    UnionFind forestUf(n);
+    vector<int> comp(n);
+    vector<atomic<uint64_t> > best(n);
+    vector<int> forest;
+    const uint64_t NONE = 0;  // every real key is > 0 (its low half is ~index)
+    if (verbose) cout << "Starting with " << n << " components (each photo is separate)" << endl << endl;
+
+    for (int round = 1; !live.empty(); round++) {
+        for (int v = 0; v < n; v++) {
+            comp[v] = forestUf.find(v);
+            best[v].store(NONE);
+        }
+
+        // Each group's most similar outgoing edge, found in parallel
+        auto scan = [&](int t) {
+            int lo = (int)((long long)live.size() * t / threads);
+            int hi = (int)((long long)live.size() * (t + 1) / threads);
+            for (int i = lo; i < hi; i++) {
+                const Edge& e = edges[live[i]];
+                uint64_t key = boruvkaKey(e, live[i]);
+                int ends[2] = {comp[e.u], comp[e.v]};
+                for (int side = 0; side < 2; side++) {
+                    uint64_t cur = best[ends[side]].load();
+                    while (key > cur && !best[ends[side]].compare_exchange_weak(cur, key)) {
+                    }
+                }
+            }
+        };
+        vector<thread> pool;
+        for (int t = 1; t < threads; t++) pool.push_back(thread(scan, t));
+        scan(0);
+        for (int t = 0; t < (int)pool.size(); t++) pool[t].join();
+
+        // Merge every group with its chosen neighbor
+        for (int c = 0; c < n; c++) {
+            uint64_t key = best[c].load();
+            if (key == NONE) continue;
+            int index = (int)~(uint32_t)key;
+            if (forestUf.unite(edges[index].u, edges[index].v)) forest.push_back(index);
+        }
+        if (verbose) {
+            cout << "Boruvka round " << round << ": " << forestUf.getComponents() << " groups in the spanning forest" << endl;
+        }
 
-        if (ss >> photo1 >> photo2 >> similarity) {
-            // Convert photo names like p1, p2 to indices 0, 1, etc
-            int u = stoi(photo1.substr(1)) - 1;
-            int v = stoi(photo2.substr(1)) - 1;
-            edges.push_back(Edge(u, v, similarity));
+        // Drop edges that now lie inside one group
+        vector<int> remaining;
+        for (int i = 0; i < (int)live.size(); i++) {
+            const Edge& e = edges[live[i]];
+            if (!forestUf.connected(e.u, e.v)) remaining.push_back(live[i]);
         }
+        live.swap(remaining);
     }
-    inputFile.close();
-    
-    int n = 20;  // number of photos
+    if (verbose) cout << endl;
+
+    // Kruskal's merges are the forest edges in descending order, so apply them until k groups remain
+    vector<Edge> forestEdges;
+    for (int i = 0; i < (int)forest.size(); i++) {
+        forestEdges.push_back(edges[forest[i]]);
+    }
+    sort(forestEdges.begin(), forestEdges.end(), compareEdges);
+
+    int edgesProcessed = 0;
+    for (int i = 0; i < (int)forestEdges.size() && uf.getComponents() > k; i++) {
+        const Edge& e = forestEdges[i];
+        if (verbose) {
+            cout << "Merging p" << (e.u + 1) << " and p" << (e.v + 1)
+                 << " (similarity: " << e.weight << ") -> ";
+        }
+        uf.unite(e.u, e.v);
+        edgesProcessed++;
+        if (mergeLog) mergeLog->push_back(e);
+        if (verbose) cout << uf.getComponents() << " groups remaining" << endl;
+    }
+    if (verbose && uf.getComponents() <= k) {
+        cout << "Reached target of " << k << " groups, stopping..." << endl;
+    }
+    return edgesProcessed;
+}
+
+// Per-photo feature vectors, row-major. Rows are L2-normalised on load, so
+// a dot product is the cosine similarity, and padded with zeros to a
+// multiple of 16 floats so the SIMD kernels need no tail loop.
+struct FeatureMatrix {
+    int numPhotos;
+    int dim;
+    int stride;
+    vector<float> values;
+
+    const float* row(int i) const {
+        return &values[(size_t)i * stride];
+    }
+};
+
+// Cosine similarity is scaled to an integer Edge weight (1.0 -> 1000000);
+// the wide range goes through the radix path of --order=bucket
+const int SIMILARITY_SCALE = 1000000;
+
+void normalizeFeatures(FeatureMatrix& f) {
+    for (int i = 0; i < f.numPhotos; i++) {
+        float* r = &f.values[(size_t)i * f.stride];
+        double norm = 0;
+        for (int d = 0; d < f.dim; d++) norm += (double)r[d] * r[d];
+        if (norm == 0) continue;
+        float scale = (float)(1.0 / sqrt(norm));
+        for (int d = 0; d < f.dim; d++) r[d] *= scale;
+    }
+}
+
+// Binary feature file: int32 photo count, int32 dimension, then count x
+// dimension float32 values, photo by photo
+bool loadFeatures(FeatureMatrix& f, const string& fileName) {
+    ifstream in(fileName.c_str(), ios::binary);
+    if (!in.is_open()) return false;
+    int32_t header[2];
+    if (!in.read((char*)header, sizeof(header)) || header[0] < 0 || header[1] <= 0) return false;
+    f.numPhotos = header[0];
+    f.dim = header[1];
+    f.stride = (f.dim + 15) / 16 * 16;
+    f.values.assign((size_t)f.numPhotos * f.stride, 0.0f);
+    for (int i = 0; i < f.numPhotos; i++) {
+        if (!in.read((char*)&f.values[(size_t)i * f.stride], (streamsize)f.dim * sizeof(float))) return false;
+    }
+    normalizeFeatures(f);
+    return true;
+}
+
+// Dot products of one row a against four rows b[0..3], sharing the loads
+// of a. n is the padded stride (a multiple of 16).
+static void dotProducts4(const float* a, const float* const* b, int n, bool simd, float* out) {
+#if defined(__AVX512F__)
+    if (simd) {
+        __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+        __m512 acc2 = _mm512_setzero_ps(), acc3 = _mm512_setzero_ps();
+        for (int d = 0; d < n; d += 16) {
+            __m512 x = _mm512_loadu_ps(a + d);
+            acc0 = _mm512_fmadd_ps(x, _mm512_loadu_ps(b[0] + d), acc0);
+            acc1 = _mm512_fmadd_ps(x, _mm512_loadu_ps(b[1] + d), acc1);
+            acc2 = _mm512_fmadd_ps(x, _mm512_loadu_ps(b[2] + d), acc2);
+            acc3 = _mm512_fmadd_ps(x, _mm512_loadu_ps(b[3] + d), acc3);
+        }
+        out[0] = _mm512_reduce_add_ps(acc0);
+        out[1] = _mm512_reduce_add_ps(acc1);
+        out[2] = _mm512_reduce_add_ps(acc2);
+        out[3] = _mm512_reduce_add_ps(acc3);
+        return;
+    }
+#elif defined(__AVX2__) && defined(__FMA__)
+    if (simd) {
+        __m256 acc[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+        for (int d = 0; d < n; d += 8) {
+            __m256 x = _mm256_loadu_ps(a + d);
+            for (int j = 0; j < 4; j++) {
+                acc[j] = _mm256_fmadd_ps(x, _mm256_loadu_ps(b[j] + d), acc[j]);
+            }
+        }
+        for (int j = 0; j < 4; j++) {
+            // Horizontal sum of the eight lanes
+            __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc[j]), _mm256_extractf128_ps(acc[j], 1));
+            s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+            s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+            out[j] = _mm_cvtss_f32(s);
+        }
+        return;
+    }
+#endif
+    (void)simd;
+    for (int j = 0; j < 4; j++) {
+        float sum = 0;
+        for (int d = 0; d < n; d++) sum += a[d] * b[j][d];
+        out[j] = sum;
+    }
+}
+
+// Which dot-product kernel this build uses
+string similarityKernelName() {
+#if defined(__AVX512F__)
+    return "AVX-512";
+#elif defined(__AVX2__) && defined(__FMA__)
+    return "AVX2+FMA";
+#else
+    return "scalar (build with make SIMD=1 for SIMD)";
+#endif
+}
+
+// Keeps the topM most similar candidates as a min-heap on similarity, so
+// the weakest kept neighbour is at the front
+struct NeighbourHeap {
+    vector<pair<float, int> > items;
+
+    static bool weaker(const pair<float, int>& a, const pair<float, int>& b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    }
+
+    void offer(float similarity, int photo, int topM) {
+        if ((int)items.size() < topM) {
+            items.push_back(make_pair(similarity, photo));
+            push_heap(items.begin(), items.end(), weaker);
+        } else if (similarity > items.front().first) {
+            pop_heap(items.begin(), items.end(), weaker);
+            items.back() = make_pair(similarity, photo);
+            push_heap(items.begin(), items.end(), weaker);
+        }
+    }
+};
+
+// Top-M nearest neighbour graph by cosine similarity. Threads take blocks
+// of rowBlock photos and sweep every other photo in column tiles sized to
+// stay in L2, so each tile is reused by the whole row block before moving
+// on. A thread owns its rows' heaps outright, so every pair is computed from
+// both sides instead of sharing heaps across threads. A pair picked by both
+// photos becomes one edge. The result is exact brute force: O(n^2 * dim)
+// work, just with a small constant.
+vector<Edge> buildSimilarityGraph(const FeatureMatrix& f, int topM, int threads, bool simd = true) {
+    int n = f.numPhotos;
+    if (threads < 1) threads = 1;
+    if (topM > n - 1) topM = n - 1;
+    if (topM < 1) return vector<Edge>();  // no neighbours wanted (or only one photo)
+    const int rowBlock = 32;
+    int colBlock = max(16, (256 * 1024 / 4) / f.stride) / 4 * 4;   // about 256KB of rows
+    int numRowBlocks = (n + rowBlock - 1) / rowBlock;
+    vector<NeighbourHeap> heaps(n);
+    atomic<int> nextBlock(0);
+
+    auto worker = [&]() {
+        float sims[4];
+        const float* rows[4];
+        int ids[4];
+        for (int block = nextBlock++; block < numRowBlocks; block = nextBlock++) {
+            int rowLo = block * rowBlock, rowHi = min(n, rowLo + rowBlock);
+            for (int colLo = 0; colLo < n; colLo += colBlock) {
+                int colHi = min(n, colLo + colBlock);
+                for (int i = rowLo; i < rowHi; i++) {
+                    const float* a = f.row(i);
+                    NeighbourHeap& heap = heaps[i];
+                    int count = 0;
+                    for (int j = colLo; j < colHi; j++) {
+                        if (j == i) continue;
+                        rows[count] = f.row(j);
+                        ids[count++] = j;
+                        if (count == 4 || j == colHi - 1) {
+                            for (int c = count; c < 4; c++) rows[c] = a;   // padding lanes, ignored
+                            dotProducts4(a, rows, f.stride, simd, sims);
+                            for (int c = 0; c < count; c++) heap.offer(sims[c], ids[c], topM);
+                            count = 0;
+                        }
+                    }
+                    if (count > 0) {
+                        for (int c = count; c < 4; c++) rows[c] = a;
+                        dotProducts4(a, rows, f.stride, simd, sims);
+                        for (int c = 0; c < count; c++) heap.offer(sims[c], ids[c], topM);
+                    }
+                }
+            }
+        }
+    };
+    vector<thread> pool;
+    for (int t = 1; t < threads; t++) pool.push_back(thread(worker));
+    worker();
+    for (int t = 0; t < (int)pool.size(); t++) pool[t].join();
+
+    // Photo i emits its neighbour j unless j < i already emitted the pair
+    vector<Edge> edges;
+    edges.reserve((size_t)n * topM);
+    for (int i = 0; i < n; i++) {
+        sort_heap(heaps[i].items.begin(), heaps[i].items.end(), NeighbourHeap::weaker);
+        for (int e = 0; e < (int)heaps[i].items.size(); e++) {
+            int j = heaps[i].items[e].second;
+            if (j < i) {
+                bool emitted = false;
+                for (int x = 0; x < (int)heaps[j].items.size() && !emitted; x++) {
+                    emitted = heaps[j].items[x].second == i;
+                }
+                if (emitted) continue;
+            }
+            int weight = (int)lround(heaps[i].items[e].first * SIMILARITY_SCALE);
+            edges.push_back(Edge(i, j, weight));
+        }
+    }
+    return edges;
+}
+
+// Full sort vs the lazy Filter-Kruskal source vs bucket sorting on large
+// random similarity graphs (narrow and full-range weights), for several
+// target group counts
+void runEdgeOrderBenchmark() {
+    int n = 1000000;
+    int m = 10000000;
+    int targets[] = {n / 2, n / 10, 1000};
+    int maxWeights[] = {100, 1000000000};
+    const int numOrders = 3;
+    EdgeOrder orders[numOrders] = {FULL_SORT, FILTER_KRUSKAL, BUCKET_SORT};
+    mt19937 rng(375);
+    uniform_int_distribution<int> pickPhoto(0, n - 1);
+
+    for (int w = 0; w < 2; w++) {
+        uniform_int_distribution<int> pickWeight(0, maxWeights[w]);
+        vector<Edge> base;
+        base.reserve(m);
+        for (int i = 0; i < m; i++) {
+            base.push_back(Edge(pickPhoto(rng), pickPhoto(rng), pickWeight(rng)));
+        }
+
+        cout << "=== EDGE ORDERING BENCHMARK (" << n << " photos, " << m << " edges, weights 0-"
+             << maxWeights[w] << ") ===" << endl;
+        cout << "Target groups\tFull sort(us)\tFilter-Kruskal(us)\tBucket sort(us)\tMerges" << endl;
+        for (int t = 0; t < 3; t++) {
+            long long times[numOrders];
+            int merges[numOrders];
+            for (int o = 0; o < numOrders; o++) {
+                vector<Edge> edges(base);
+                UnionFind uf(n);
+                auto start = high_resolution_clock::now();
+                merges[o] = clusterPhotos(edges, uf, targets[t], orders[o], false);
+                auto end = high_resolution_clock::now();
+                times[o] = duration_cast<microseconds>(end - start).count();
+            }
+            bool same = merges[0] == merges[1] && merges[0] == merges[2];
+            cout << targets[t] << "\t" << times[0] << "\t" << times[1] << "\t" << times[2] << "\t" << merges[0]
+                 << (same ? "" : "\t(MERGE COUNTS DIFFER!)") << endl;
+        }
+        cout << endl;
+    }
+}
+
+// The single-threaded UnionFind vs ConcurrentUnionFind on growing thread
+// counts, uniting a large random edge list (e.g. every edge above a
+// similarity threshold, where merge order does not matter)
+void runUnionFindBenchmark() {
+    int n = 10000000;  // about one edge per photo, so many groups remain to compare
+    int m = 10000000;
+    int threadCounts[] = {1, 2, 4, 8, 16, 32, 64};
+    mt19937 rng(375);
+    uniform_int_distribution<int> pickPhoto(0, n - 1);
+
+    vector<Edge> edges;
+    edges.reserve(m);
+    for (int i = 0; i < m; i++) {
+        edges.push_back(Edge(pickPhoto(rng), pickPhoto(rng), 0));
+    }
+
+    cout << "=== UNION-FIND BENCHMARK (" << n << " photos, " << m << " edges, "
+         << thread::hardware_concurrency() << " hardware threads) ===" << endl;
+
+    UnionFind uf(n);
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < m; i++) {
+        uf.unite(edges[i].u, edges[i].v);
+    }
+    auto end = high_resolution_clock::now();
+    cout << "UnionFind (1 thread): " << duration_cast<microseconds>(end - start).count()
+         << " us, " << uf.getComponents() << " groups" << endl;
+
+    for (int t = 0; t < 7; t++) {
+        ConcurrentUnionFind cuf(n);
+        start = high_resolution_clock::now();
+        parallelUniteEdges(edges, cuf, threadCounts[t]);
+        end = high_resolution_clock::now();
+        cout << "ConcurrentUnionFind (" << threadCounts[t] << " threads): "
+             << duration_cast<microseconds>(end - start).count() << " us, " << cuf.getComponents() << " groups"
+             << (cuf.getComponents() == uf.getComponents() ? "" : " (GROUP COUNTS DIFFER!)") << endl;
+    }
+}
+
+// Scalar vs SIMD similarity kernels and thread scaling on synthetic
+// clustered feature vectors
+void runSimilarityBenchmark() {
+    const int n = 4096, dim = 512, centres = 32, topM = 10;
+    mt19937 rng(515);
+    normal_distribution<float> gauss(0.0f, 1.0f);
+    vector<vector<float> > centre(centres, vector<float>(dim));
+    for (int c = 0; c < centres; c++) {
+        for (int d = 0; d < dim; d++) centre[c][d] = gauss(rng);
+    }
+    FeatureMatrix f;
+    f.numPhotos = n;
+    f.dim = dim;
+    f.stride = (dim + 15) / 16 * 16;
+    f.values.assign((size_t)n * f.stride, 0.0f);
+    for (int i = 0; i < n; i++) {
+        for (int d = 0; d < dim; d++) f.values[(size_t)i * f.stride + d] = centre[i % centres][d] + 0.5f * gauss(rng);
+    }
+    normalizeFeatures(f);
+
+    cout << "=== SIMILARITY GRAPH BENCHMARK (" << n << " photos x " << dim << " dims, top " << topM
+         << ", kernel: " << similarityKernelName() << ") ===" << endl;
+    cout << "Kernel\tThreads\tTime(us)\tGFLOP/s\tEdges" << endl;
+    double flops = 2.0 * n * (double)(n - 1) * f.stride;
+    auto start = high_resolution_clock::now();
+    vector<Edge> reference = buildSimilarityGraph(f, topM, 1, false);
+    auto end = high_resolution_clock::now();
+    long long us = duration_cast<microseconds>(end - start).count();
+    cout << "scalar\t1\t" << us << "\t" << flops / max(us, 1LL) / 1000 << "\t" << reference.size() << endl;
+
+    int maxThreads = max(1, (int)thread::hardware_concurrency());
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        start = high_resolution_clock::now();
+        vector<Edge> edges = buildSimilarityGraph(f, topM, threads, true);
+        end = high_resolution_clock::now();
+        us = duration_cast<microseconds>(end - start).count();
+        int differing = 0;
+        for (int i = 0; i < (int)edges.size() && i < (int)reference.size(); i++) {
+            if (edges[i].u != reference[i].u || edges[i].v != reference[i].v) differing++;
+        }
+        cout << "simd\t" << threads << "\t" << us << "\t" << flops / max(us, 1LL) / 1000 << "\t" << edges.size();
+        if (differing > 0 || edges.size() != reference.size()) cout << "\t(" << differing << " edges differ from scalar, float rounding)";
+        cout << endl;
+    }
+
+    vector<Edge> edges = buildSimilarityGraph(f, topM, maxThreads, true);
+    UnionFind uf(n);
+    clusterPhotos(edges, uf, centres, BUCKET_SORT, false);
+    cout << "Clustered into " << uf.getComponents() << " groups (" << centres << " synthetic centres)" << endl << endl;
+}
+
+int main(int argc, char* argv[]) {
+    EdgeOrder order = FILTER_KRUSKAL;
+    bool boruvka = false;
     int k = 3;   // number of groups we want
+    bool explicitK = false;
+    int minSimilarity = INT_MIN;
+    bool useThreshold = false;
+    string saveDendrogramFile, loadDendrogramFile;
+    bool stream = false;
+    int checkpointEvery = 0;
+    string featuresFile;
+    int topM = 10;
+    int threads = thread::hardware_concurrency();
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--engine=kruskal") {
+            boruvka = false;
+        } else if (arg == "--engine=boruvka") {
+            boruvka = true;
+        } else if (arg.compare(0, 10, "--threads=") == 0) {
+            threads = atoi(arg.c_str() + 10);
+        } else if (arg.compare(0, 4, "--k=") == 0) {
+            k = atoi(arg.c_str() + 4);
+            explicitK = true;
+        } else if (arg.compare(0, 12, "--threshold=") == 0) {
+            minSimilarity = atoi(arg.c_str() + 12);
+            useThreshold = true;
+        } else if (arg.compare(0, 18, "--save-dendrogram=") == 0) {
+            saveDendrogramFile = arg.substr(18);
+        } else if (arg.compare(0, 18, "--load-dendrogram=") == 0) {
+            loadDendrogramFile = arg.substr(18);
+        } else if (arg == "--stream") {
+            stream = true;
+        } else if (arg.compare(0, 19, "--checkpoint-every=") == 0) {
+            checkpointEvery = atoi(arg.c_str() + 19);
+        } else if (arg.compare(0, 11, "--features=") == 0) {
+            featuresFile = arg.substr(11);
+        } else if (arg.compare(0, 6, "--top=") == 0) {
+            topM = atoi(arg.c_str() + 6);
+            if (topM < 1) {
+                cout << "Error: --top must be at least 1" << endl;
+                return 1;
+            }
+        } else if (arg == "--order=full") {
+            order = FULL_SORT;
+        } else if (arg == "--order=filter") {
+            order = FILTER_KRUSKAL;
+        } else if (arg == "--order=bucket") {
+            order = BUCKET_SORT;
+        } else if (arg == "--bench-order") {
+            runEdgeOrderBenchmark();
+            return 0;
+        } else if (arg == "--bench-uf") {
+            runUnionFindBenchmark();
+            return 0;
+        } else if (arg == "--bench-sim") {
+            runSimilarityBenchmark();
+            return 0;
+        } else {
+            cout << "Usage: " << argv[0] << " [--engine=kruskal|boruvka] [--threads=N] [--order=full|filter|bucket]"
+                 << " [--k=N] [--threshold=T] [--save-dendrogram=FILE] [--load-dendrogram=FILE]"
+                 << " [--stream [--checkpoint-every=N]] [--features=FILE [--top=M]]"
+                 << " [--bench-order] [--bench-uf] [--bench-sim]" << endl;
+            return 1;
+        }
+    }
+
+    // A threshold on its own merges everything at least that similar
+    if (useThreshold && !explicitK) k = 1;
+
+    int n = 20;  // number of photos
+    vector<Edge> edges;
+    Dendrogram dendrogram;
+    bool useDendrogram = useThreshold || !saveDendrogramFile.empty() || !loadDendrogramFile.empty();
+
+    if (!loadDendrogramFile.empty()) {
+        // Answer straight from a saved merge sequence, no edges needed
+        if (!loadDendrogram(dendrogram, loadDendrogramFile)) {
+            cout << "Error: Could not read dendrogram " << loadDendrogramFile << endl;
+            return 1;
+        }
+        n = dendrogram.numPhotos;
+    } else if (!featuresFile.empty()) {
+        // Build the similarity edges from feature vectors instead of B1_input.txt
+        FeatureMatrix features;
+        if (!loadFeatures(features, featuresFile)) {
+            cout << "Error: Could not read features " << featuresFile << endl;
+            return 1;
+        }
+        n = features.numPhotos;
+        auto buildStart = high_resolution_clock::now();
+        edges = buildSimilarityGraph(features, topM, threads);
+        auto buildEnd = high_resolution_clock::now();
+        cout << "Similarity graph: " << n << " photos x " << features.dim << " dims, top " << topM << " ("
+             << similarityKernelName() << ", " << max(threads, 1) << " threads): " << edges.size() << " edges in "
+             << duration_cast<microseconds>(buildEnd - buildStart).count() << " microseconds" << endl;
+    } else if (!loadPhotoEdges("B1_input.txt", edges, n)) {
+        cout << "Error: Could not read B1_input.txt (missing, or a photo above p" << MAX_PHOTOS << ")" << endl;
+        return 1;
+    }
+
+    if (stream) {
+        // Seed with the saved state or with B1_input.txt, then keep going;
+        // --save-dendrogram names the checkpoint file
+        IncrementalClusterer clusterer(n);
+        if (!loadDendrogramFile.empty()) {
+            if (!clusterer.restore(loadDendrogramFile)) {
+                cout << "Error: Could not restore checkpoint " << loadDendrogramFile << endl;
+                return 1;
+            }
+        } else {
+            for (int i = 0; i < (int)edges.size(); i++) {
+                clusterer.addEdge(edges[i].u, edges[i].v, edges[i].weight);
+            }
+        }
+        cout << "Streaming: " << clusterer.numPhotos() << " photos, " << clusterer.storedEdges()
+             << " edges kept, reading commands from stdin" << endl;
+        runStreamMode(clusterer, k, saveDendrogramFile, checkpointEvery);
+        return 0;
+    }
 
     cout << "Starting photo classification..." << endl;
     cout << "Total photos: " << n << endl;
     cout << "Target groups: " << k << endl;
+    if (useThreshold) cout << "Similarity threshold: " << minSimilarity << endl;
     cout << "Total edges: " << edges.size() << endl << endl;
 
     auto start = high_resolution_clock::now();
 
-    // Sort edges by weight (descending order for max similarity)
-    sort(edges.begin(), edges.end(), compareEdges);
-    cout << "Edges sorted by similarity (highest first)" << endl;
-
     UnionFind uf(n);
-    cout << "Starting with " << uf.getComponents() << " components (each photo is separate)" << endl << endl;
-
-    // Process edges until we have k groups
-    int edgesProcessed = 0;
-    for (int i = 0; i < (int)edges.size(); i++) {
-        if (uf.getComponents() <= k) {
-            cout << "Reached target of " << k << " groups, stopping..." << endl;
-            break;  // we have our 3 groups
+    int edgesProcessed;
+    if (useDendrogram) {
+        if (loadDendrogramFile.empty()) {
+            // Record every merge down to one group, then answer from the record
+            UnionFind full(n);
+            dendrogram.numPhotos = n;
+            if (boruvka) boruvkaCluster(edges, full, 1, threads, false, &dendrogram.merges);
+            else clusterPhotos(edges, full, 1, order, false, &dendrogram.merges);
         }
-
-        if (!uf.connected(edges[i].u, edges[i].v)) {
-            cout << "Merging p" << (edges[i].u + 1) << " and p" << (edges[i].v + 1)
-                 << " (similarity: " << edges[i].weight << ") -> ";
-            uf.unite(edges[i].u, edges[i].v);
-            edgesProcessed++;
-            cout << uf.getComponents() << " groups remaining" << endl;
+        if (!saveDendrogramFile.empty()) {
+            if (saveDendrogram(dendrogram, saveDendrogramFile)) {
+                cout << "Saved dendrogram (" << dendrogram.merges.size() << " merges) to " << saveDendrogramFile << endl;
+            } else {
+                cout << "Error: Could not write dendrogram " << saveDendrogramFile << endl;
+            }
         }
+        cout << "Answering from dendrogram with " << dendrogram.merges.size() << " merges" << endl;
+        edgesProcessed = applyDendrogram(dendrogram, uf, k, minSimilarity);
+    } else {
+        bool verbose = n <= 1000;  // per-merge progress only for small inputs
+        edgesProcessed = boruvka ? boruvkaCluster(edges, uf, k, threads, verbose)
+                                 : clusterPhotos(edges, uf, k, order, verbose);
     }
     cout << endl << "Total edges used: " << edgesProcessed << endl << endl;
     
     auto end = high_resolution_clock::now();
     auto duration = duration_cast<microseconds>(end - start);
     
-    // Group photos by their root parent
-    map<int, vector<int> > groups;
-    for (int i = 0; i < n; i++) {
-        int root = uf.find(i);
-        groups[root].push_back(i + 1);  // +1 to convert back to photo numbers
-    }
-
     // Print results
     cout << "Final Groups:" << endl;
     cout << "-------------" << endl;
     cout << "//** Print out the three groups of photos in terms of number of photos N and individual photos p **//" << endl;
-    int groupNum = 1;
-    for (map<int, vector<int> >::iterator it = groups.begin(); it != groups.end(); ++it) {
-        cout << "Group " << groupNum << " = " << it->second.size() << "; photos: ";
-        for (int i = 0; i < (int)it->second.size(); i++) {
-            cout << "p" << it->second[i];
-            if (i < (int)it->second.size() - 1) {
-                cout << ", ";
-            }
-        }
-        cout << endl;
-        groupNum++;
-    }
+    printGroups(uf, n, cout);
     cout << endl;
 
     cout << "//** print out running time **//" << endl;
@@ -177,16 +1316,7 @@ int main() {
     ofstream outputFile("B1_output.txt");
     if (outputFile.is_open()) {
         outputFile << "//** Print out the three groups of photos in terms of number of photos N and individual photos p **//" << endl;
-        groupNum = 1;
-        for (map<int, vector<int> >::iterator it = groups.begin(); it != groups.end(); ++it) {
-            outputFile << "Group " << groupNum << " = " << it->second.size() << "; photos: ";
-            for (int i = 0; i < (int)it->second.size(); i++) {
-                outputFile << "p" << it->second[i];
-                if (i < (int)it->second.size() - 1) outputFile << ", ";
-            }
-            outputFile << endl;
-            groupNum++;
-        }
+        printGroups(uf, n, outputFile);
         outputFile << endl;
         outputFile << "//** print out running time **//" << endl;
         outputFile << "Running-time: " << duration.count() << " microseconds" << endl;
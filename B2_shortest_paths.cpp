@@ -1,278 +1,3109 @@
 #include <iostream>
 #include <vector>
+#include <string>
 #include <climits>
+#include <cstdint>
 #include <map>
+#include <unordered_map>
 #include <queue>
+#include <random>
 #include <chrono>
 #include <fstream>
-#include <sstream>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "edge_loader.h"
+#include "graph_snapshot.h"
+#include "path_arena.h"
 
 using namespace std;
 using namespace std::chrono;
 
-// Edge structure for adjacency list
+typedef uint32_t VertexId;  // dense vertex id, 0 .. numNodes-1
+
+// Edge as read from the input (stored until the CSR arrays are built)
 struct Edge {
-    char to;
+    VertexId from, to;
     int weight;
 
-    Edge(char to, int weight) {
-        this->to = to;
-        this->weight = weight;
+    Edge(VertexId from, VertexId to, int weight) {
+        this->from = from;
+        this->to = to;
+        this->weight = weight;
+    }
+};
+
+// Type aliases to make complex types easier to read
+typedef pair<string, string> CityPair;            // (start city, end city) by name
+typedef pair<VertexId, VertexId> VertexPair;      // (start city, end city) by id
+typedef PathView<VertexId> VertexPath;            // vertices owned by a PathArena<VertexId>
+typedef pair<int, VertexPath> PathResult;         // (distance, path)
+
+// Shortest-path tree from one source: distances and parent pointers.
+// subtree[v] is the child of the source whose subtree holds v (the source
+// itself for the source, -1 if unreachable); it is filled in the first
+// time Algorithm 2 needs it.
+struct ShortestPathTree {
+    vector<int> dist;
+    vector<int> parent;
+    vector<int> subtree;
+};
+
+// Maps city names to dense vertex ids and back. While attached to a
+// snapshot, names and lookups are served from the mapped file instead.
+class VertexDictionary {
+private:
+    unordered_map<string, VertexId> ids;
+    vector<string> names;
+    const GraphSnapshot* snapshot;
+
+public:
+    static const VertexId NOT_FOUND = UINT32_MAX;
+
+    VertexDictionary() : snapshot(NULL) {}
+
+    void attach(const GraphSnapshot* mapped) {
+        ids.clear();
+        names.clear();
+        snapshot = mapped;
+    }
+
+    // Copy the mapped names into memory so new names can be added
+    void detach() {
+        if (snapshot == NULL) return;
+        for (uint32_t id = 0; id < snapshot->getNumNodes(); id++) {
+            names.push_back(string(snapshot->nameData(id), snapshot->nameLength(id)));
+            ids[names.back()] = id;
+        }
+        snapshot = NULL;
+    }
+
+    VertexId getOrAdd(const string& name) {
+        unordered_map<string, VertexId>::iterator it = ids.find(name);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        VertexId id = (VertexId)names.size();
+        ids[name] = id;
+        names.push_back(name);
+        return id;
+    }
+
+    VertexId find(const string& name) const {
+        if (snapshot != NULL) {
+            uint32_t id = snapshot->find(name.data(), name.size());
+            return id == SNAPSHOT_NO_VERTEX ? NOT_FOUND : id;
+        }
+        unordered_map<string, VertexId>::const_iterator it = ids.find(name);
+        return it == ids.end() ? NOT_FOUND : it->second;
+    }
+
+    TokenView name(VertexId id) const {
+        TokenView view;
+        if (snapshot != NULL) {
+            view.data = snapshot->nameData(id);
+            view.length = (uint32_t)snapshot->nameLength(id);
+        } else {
+            view.data = names[id].data();
+            view.length = (uint32_t)names[id].size();
+        }
+        return view;
+    }
+
+    int size() const { return snapshot != NULL ? (int)snapshot->getNumNodes() : (int)names.size(); }
+};
+
+// Priority queues for Dijkstra. All three share the same interface
+// (push(key, vertex), pop() -> (key, vertex), empty()) and use lazy
+// deletion: stale entries are skipped by the caller when popped.
+
+// Binary heap - works for any weights, O(log n) per operation
+class BinaryHeapQueue {
+private:
+    priority_queue<pair<int, int>, vector<pair<int, int> >, greater<pair<int, int> > > pq;
+
+public:
+    explicit BinaryHeapQueue(int /* maxWeight */) {}
+
+    void push(int key, int v) { pq.push(make_pair(key, v)); }
+
+    pair<int, int> pop() {
+        pair<int, int> top = pq.top();
+        pq.pop();
+        return top;
+    }
+
+    bool empty() const { return pq.empty(); }
+};
+
+// Radix heap - monotone queue for non-negative integer keys. Bucket i holds
+// keys whose highest bit differing from the last popped key is bit i-1, so
+// each entry moves down at most 32 times over its lifetime.
+class RadixHeapQueue {
+private:
+    vector<pair<int, int> > buckets[33];
+    unsigned last;
+    int count;
+
+    static int bucketFor(unsigned key, unsigned last) {
+        return key == last ? 0 : 32 - __builtin_clz(key ^ last);
+    }
+
+public:
+    explicit RadixHeapQueue(int /* maxWeight */) {
+        last = 0;
+        count = 0;
+    }
+
+    void push(int key, int v) {
+        buckets[bucketFor((unsigned)key, last)].push_back(make_pair(key, v));
+        count++;
+    }
+
+    pair<int, int> pop() {
+        if (buckets[0].empty()) {
+            // Find the first non-empty bucket and redistribute it around its minimum
+            int i = 1;
+            while (buckets[i].empty()) i++;
+
+            unsigned newLast = UINT_MAX;
+            for (int j = 0; j < (int)buckets[i].size(); j++) {
+                if ((unsigned)buckets[i][j].first < newLast) newLast = buckets[i][j].first;
+            }
+            last = newLast;
+
+            for (int j = 0; j < (int)buckets[i].size(); j++) {
+                const pair<int, int>& item = buckets[i][j];
+                buckets[bucketFor((unsigned)item.first, last)].push_back(item);
+            }
+            buckets[i].clear();
+        }
+
+        pair<int, int> top = buckets[0].back();
+        buckets[0].pop_back();
+        count--;
+        return top;
+    }
+
+    bool empty() const { return count == 0; }
+};
+
+// Dial's bucket queue - a circular array of maxWeight+1 buckets. Every live
+// key lies in [current, current + maxWeight], so each bucket holds exactly one
+// distance at a time. Best when maxWeight is small.
+class DialQueue {
+private:
+    vector<vector<int> > buckets;
+    int current;
+    int count;
+
+public:
+    explicit DialQueue(int maxWeight) {
+        buckets.resize(maxWeight + 1);
+        current = 0;
+        count = 0;
+    }
+
+    void push(int key, int v) {
+        buckets[key % buckets.size()].push_back(v);
+        count++;
+    }
+
+    pair<int, int> pop() {
+        while (buckets[current % buckets.size()].empty()) current++;
+        vector<int>& bucket = buckets[current % buckets.size()];
+        int v = bucket.back();
+        bucket.pop_back();
+        count--;
+        return make_pair(current, v);
+    }
+
+    bool empty() const { return count == 0; }
+};
+
+// Which priority queue dijkstraWithParents uses (DELTA_STEPPING swaps the
+// queue for the parallel bucket engine, with the same result shape)
+enum QueueKind { BINARY_HEAP, RADIX_HEAP, DIAL_BUCKETS, DELTA_STEPPING };
+
+// Reusable barrier for a fixed team of threads
+class RoundBarrier {
+private:
+    mutex m;
+    condition_variable cv;
+    int threads;
+    int waiting;
+    int generation;
+
+public:
+    explicit RoundBarrier(int threads) {
+        this->threads = threads;
+        waiting = 0;
+        generation = 0;
+    }
+
+    void wait() {
+        unique_lock<mutex> lock(m);
+        int gen = generation;
+        if (++waiting == threads) {
+            waiting = 0;
+            generation++;
+            cv.notify_all();
+        } else {
+            cv.wait(lock, [&] { return gen != generation; });
+        }
+    }
+};
+
+// (capital, start, end) triple for the batch API
+struct RouteQuery {
+    VertexId capital, from, to;
+};
+
+// Work-stealing thread pool. Every worker owns a deque of tasks: it pushes
+// and pops at the back (newest first, so spawned work stays cache-warm)
+// and, when its own deque is empty, steals from the front of another
+// worker's. Tasks may submit more tasks; run() returns once every task,
+// including spawned ones, has finished.
+class WorkStealingPool {
+private:
+    struct WorkerQueue {
+        mutex lock;
+        deque<function<void()> > tasks;
+    };
+    vector<WorkerQueue> queues;
+    atomic<int> pending;
+    int nextQueue;  // round-robin target for tasks submitted from outside run()
+
+    static int& currentWorker() {
+        static thread_local int worker = -1;
+        return worker;
+    }
+
+    bool takeTask(int self, function<void()>& task) {
+        {
+            lock_guard<mutex> guard(queues[self].lock);
+            if (!queues[self].tasks.empty()) {
+                task.swap(queues[self].tasks.back());
+                queues[self].tasks.pop_back();
+                return true;
+            }
+        }
+        for (int i = 1; i < (int)queues.size(); i++) {
+            WorkerQueue& victim = queues[(self + i) % queues.size()];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task.swap(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void work(int self) {
+        currentWorker() = self;
+        function<void()> task;
+        while (pending.load() > 0) {
+            if (takeTask(self, task)) {
+                task();
+                task = function<void()>();
+                pending--;
+            } else {
+                this_thread::yield();
+            }
+        }
+        currentWorker() = -1;
+    }
+
+public:
+    explicit WorkStealingPool(int threads) : queues(threads < 1 ? 1 : threads), pending(0), nextQueue(0) {}
+
+    int size() const { return (int)queues.size(); }
+
+    void submit(function<void()> task) {
+        int target = currentWorker();
+        if (target < 0) target = nextQueue++ % queues.size();
+        pending++;
+        lock_guard<mutex> guard(queues[target].lock);
+        queues[target].tasks.push_back(task);
+    }
+
+    void run() {
+        vector<thread> workers;
+        for (int t = 1; t < (int)queues.size(); t++) {
+            workers.push_back(thread(&WorkStealingPool::work, this, t));
+        }
+        work(0);
+        for (int t = 0; t < (int)workers.size(); t++) workers[t].join();
+    }
+};
+
+// Graph class using compressed sparse row (CSR) adjacency:
+// the neighbors of u are targets[offsets[u] .. offsets[u+1]-1]. The csr*
+// pointers are what the algorithms read; they point either at the vectors
+// below or straight into a mapped snapshot.
+class Graph {
+private:
+    VertexDictionary dictionary;
+    vector<Edge> edgeList;      // undirected edges in input order
+    vector<uint32_t> offsets;   // numNodes + 1 entries
+    vector<VertexId> targets;   // one entry per directed edge
+    vector<int> weights;        // parallel to targets
+    vector<uint32_t> edgeIds;   // parallel to targets: the edgeList entry it came from
+    const uint32_t* csrOffsets;
+    const VertexId* csrTargets;
+    const int* csrWeights;
+    const GraphSnapshot* snapshot;  // non-NULL while the graph is served from a snapshot
+    int maxWeight;              // largest edge weight, sizes the Dial buckets
+    int zeroWeightEntries;      // CSR entries of weight 0 (-1 while served from a snapshot)
+    bool csrValid;
+    QueueKind queueKind;
+    int deltaWidth;             // delta-stepping bucket width, 0 = pick from the weights
+    int numThreads;             // delta-stepping team size
+    int numNodes;
+    map<VertexId, ShortestPathTree> treeCache;  // one tree per capital, cleared by addEdge,
+                                                // repaired by updateEdgeWeight / removeEdge
+
+    // Rebuild the CSR arrays from the edge list. Each undirected edge becomes
+    // two directed ones, and a stable counting sort keeps every vertex's
+    // neighbors in input order so ties break the same way as before.
+    void buildCSR() {
+        offsets.assign(numNodes + 1, 0);
+        for (int i = 0; i < (int)edgeList.size(); i++) {
+            offsets[edgeList[i].from + 1]++;
+            offsets[edgeList[i].to + 1]++;
+        }
+        for (int u = 0; u < numNodes; u++) {
+            offsets[u + 1] += offsets[u];
+        }
+
+        targets.resize(edgeList.size() * 2);
+        weights.resize(edgeList.size() * 2);
+        edgeIds.resize(edgeList.size() * 2);
+        maxWeight = 0;
+        zeroWeightEntries = 0;
+        vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+        for (int i = 0; i < (int)edgeList.size(); i++) {
+            const Edge& e = edgeList[i];
+            uint32_t a = next[e.from]++;
+            targets[a] = e.to;
+            weights[a] = e.weight;
+            edgeIds[a] = i;
+            uint32_t b = next[e.to]++;
+            targets[b] = e.from;
+            weights[b] = e.weight;
+            edgeIds[b] = i;
+            if (e.weight > maxWeight) maxWeight = e.weight;
+            if (e.weight == 0) zeroWeightEntries += 2;
+        }
+        csrOffsets = offsets.data();
+        csrTargets = targets.data();
+        csrWeights = weights.data();
+        csrValid = true;
+    }
+
+    void ensureCSR() {
+        if (!csrValid) buildCSR();
+    }
+
+    // Turn a snapshot-backed graph back into an in-memory edge list so it
+    // can be changed. Each undirected edge is taken from its lower endpoint
+    // (a self-loop's two entries count once).
+    void detachSnapshot() {
+        if (snapshot == NULL) return;
+        edgeList.clear();
+        for (int u = 0; u < numNodes; u++) {
+            bool loopSeen = false;
+            for (uint32_t e = csrOffsets[u]; e < csrOffsets[u + 1]; e++) {
+                VertexId v = csrTargets[e];
+                if (v == (VertexId)u) {
+                    loopSeen = !loopSeen;
+                    if (!loopSeen) continue;
+                } else if (v < (VertexId)u) {
+                    continue;
+                }
+                edgeList.push_back(Edge(u, v, csrWeights[e]));
+            }
+        }
+        dictionary.detach();
+        snapshot = NULL;
+        csrValid = false;
+    }
+
+
+    // Parent rule every engine ends with, so a tree does not depend on the
+    // queue, the thread count or on having been repaired: v takes the first
+    // neighbour u in CSR order with dist[u] + w == dist[v] and
+    // dist[u] < dist[v]. -1 if there is none (the start, unreachable
+    // vertices and vertices only reached through zero-weight ties).
+    int tightParent(const vector<int>& dist, VertexId v) const {
+        int dv = dist[v];
+        if (dv == INT_MAX) return -1;
+        for (uint32_t e = csrOffsets[v]; e < csrOffsets[v + 1]; e++) {
+            int du = dist[csrTargets[e]];
+            if (du < dv && du + csrWeights[e] == dv) return (int)csrTargets[e];
+        }
+        return -1;
+    }
+
+    // Zero-weight ties: BFS from every vertex that already has its parent,
+    // in vertex order, giving the rest theirs
+    void placeZeroWeightTies(const vector<int>& dist, VertexId start, vector<int>& parent) const {
+        int n = numNodes;
+        vector<VertexId> queue;
+        vector<char> placed(n, 0);
+        for (int v = 0; v < n; v++) {
+            if (v == (int)start || parent[v] != -1) {
+                placed[v] = 1;
+                queue.push_back(v);
+            }
+        }
+        for (size_t head = 0; head < queue.size(); head++) {
+            VertexId u = queue[head];
+            for (uint32_t e = csrOffsets[u]; e < csrOffsets[u + 1]; e++) {
+                VertexId v = csrTargets[e];
+                if (!placed[v] && dist[v] != INT_MAX && csrWeights[e] == 0 && dist[u] == dist[v]) {
+                    placed[v] = 1;
+                    parent[v] = u;
+                    queue.push_back(v);
+                }
+            }
+        }
+    }
+
+    void assignParents(const vector<int>& dist, VertexId start, vector<int>& parent) const {
+        for (int v = 0; v < numNodes; v++) {
+            parent[v] = v == (int)start ? -1 : tightParent(dist, v);
+        }
+        placeZeroWeightTies(dist, start, parent);
+    }
+
+    // Bring capital's cached tree up to date after road a - b went from
+    // oldWeight to newWeight (removed = the road is gone). Only distances
+    // that can change are touched:
+    // - Shorter road: whichever end it now improves is re-relaxed with a
+    //   Dijkstra seeded by that one vertex, which stops where nothing improves.
+    // - Longer or removed tree edge: the subtree hanging below it is
+    //   invalidated. Each invalidated vertex restarts from its best neighbour
+    //   outside the subtree, and a Dijkstra over the subtree settles the rest.
+    //   Vertices outside it keep their distances, which cannot get shorter.
+    // Parents then follow tightParent again for a, b, every vertex whose
+    // distance changed and their neighbours, the only ones whose choice can
+    // differ, so the tree equals a full recompute. Zero-weight ties are
+    // placed by a BFS over the whole graph, so with any zero-weight road
+    // every parent is re-derived.
+    void repairTree(ShortestPathTree& tree, VertexId capital, VertexId a, VertexId b, int oldWeight, int newWeight,
+                    bool removed) {
+        vector<int>& dist = tree.dist;
+        vector<int>& parent = tree.parent;
+        BinaryHeapQueue pq(maxWeight);
+        vector<VertexId> changed;
+
+        if (!removed && newWeight < oldWeight) {
+            VertexId ends[2] = {a, b};
+            for (int k = 0; k < 2; k++) {
+                VertexId x = ends[k], y = ends[1 - k];
+                if (dist[x] != INT_MAX && dist[x] + newWeight < dist[y]) {
+                    dist[y] = dist[x] + newWeight;
+                    pq.push(dist[y], (int)y);
+                    changed.push_back(y);
+                }
+            }
+        } else {
+            int root = -1;
+            if (parent[b] == (int)a && dist[a] != INT_MAX && dist[b] == dist[a] + oldWeight) root = b;
+            if (parent[a] == (int)b && dist[b] != INT_MAX && dist[a] == dist[b] + oldWeight) root = a;
+
+            if (root != -1) {
+                // Collect the subtree; INT_MAX marks a vertex as collected
+                vector<VertexId> subtree(1, (VertexId)root);
+                dist[root] = INT_MAX;
+                for (size_t i = 0; i < subtree.size(); i++) {
+                    VertexId x = subtree[i];
+                    for (uint32_t e = csrOffsets[x]; e < csrOffsets[x + 1]; e++) {
+                        VertexId y = csrTargets[e];
+                        if (parent[y] == (int)x && dist[y] != INT_MAX) {
+                            dist[y] = INT_MAX;
+                            subtree.push_back(y);
+                        }
+                    }
+                }
+                for (size_t i = 0; i < subtree.size(); i++) {
+                    VertexId x = subtree[i];
+                    for (uint32_t e = csrOffsets[x]; e < csrOffsets[x + 1]; e++) {
+                        int dy = dist[csrTargets[e]];
+                        if (dy != INT_MAX && dy + csrWeights[e] < dist[x]) dist[x] = dy + csrWeights[e];
+                    }
+                    if (dist[x] != INT_MAX) pq.push(dist[x], (int)x);
+                }
+                changed.swap(subtree);
+            }
+        }
+
+        while (!pq.empty()) {
+            pair<int, int> top = pq.pop();
+            int u = top.second;
+            if (top.first > dist[u]) continue;
+            for (uint32_t e = csrOffsets[u]; e < csrOffsets[u + 1]; e++) {
+                VertexId v = csrTargets[e];
+                int newDist = top.first + csrWeights[e];
+                if (newDist < dist[v]) {
+                    dist[v] = newDist;
+                    pq.push(newDist, (int)v);
+                    changed.push_back(v);
+                }
+            }
+        }
+
+        if (zeroWeightEntries != 0) {
+            assignParents(dist, capital, parent);
+        } else {
+            vector<VertexId> touched(changed);
+            touched.push_back(a);
+            touched.push_back(b);
+            for (size_t i = 0; i < changed.size(); i++) {
+                VertexId x = changed[i];
+                touched.insert(touched.end(), csrTargets + csrOffsets[x], csrTargets + csrOffsets[x + 1]);
+            }
+            sort(touched.begin(), touched.end());
+            touched.erase(unique(touched.begin(), touched.end()), touched.end());
+            for (size_t i = 0; i < touched.size(); i++) {
+                if (touched[i] != capital) parent[touched[i]] = tightParent(dist, touched[i]);
+            }
+        }
+        tree.subtree.clear();  // Algorithm 2 labels are rebuilt on demand
+    }
+
+    // Shared by updateEdgeWeight and removeEdge: change the first road u - v
+    // in input order, patch its CSR entries in place and repair the cache
+    bool changeEdge(VertexId u, VertexId v, int newWeight, bool removed) {
+        if (u == VertexDictionary::NOT_FOUND || v == VertexDictionary::NOT_FOUND) return false;
+        detachSnapshot();
+        ensureCSR();
+
+        // The CSR keeps input order per vertex, so the first road u - v is
+        // the first entry for v in u's list and the first for u in v's (a
+        // self-loop's two entries are the first two)
+        vector<uint32_t> entries;
+        for (uint32_t e = offsets[u]; e < offsets[u + 1] && entries.size() < (u == v ? 2u : 1u); e++) {
+            if (targets[e] == v) entries.push_back(e);
+        }
+        if (entries.empty()) return false;
+        for (uint32_t e = offsets[v]; e < offsets[v + 1] && u != v; e++) {
+            if (targets[e] == u) {
+                entries.push_back(e);
+                break;
+            }
+        }
+        uint32_t index = edgeIds[entries[0]];
+        int oldWeight = edgeList[index].weight;
+
+        if (removed) {
+            // Compact the CSR in one pass instead of rebuilding it
+            edgeList.erase(edgeList.begin() + index);
+            sort(entries.begin(), entries.end());
+            uint32_t total = (uint32_t)targets.size();
+            for (int k = 0; k < (int)entries.size(); k++) {
+                uint32_t from = entries[k] + 1, to = k + 1 < (int)entries.size() ? entries[k + 1] : total;
+                copy(targets.begin() + from, targets.begin() + to, targets.begin() + from - (k + 1));
+                copy(weights.begin() + from, weights.begin() + to, weights.begin() + from - (k + 1));
+                copy(edgeIds.begin() + from, edgeIds.begin() + to, edgeIds.begin() + from - (k + 1));
+            }
+            uint32_t write = total - (uint32_t)entries.size();
+            for (uint32_t e = 0; e < write; e++) {
+                if (edgeIds[e] > index) edgeIds[e]--;
+            }
+            targets.resize(write);
+            weights.resize(write);
+            edgeIds.resize(write);
+            for (int x = (int)min(u, v); x < numNodes; x++) {
+                offsets[x + 1] -= (uint32_t)(lower_bound(entries.begin(), entries.end(), offsets[x + 1]) - entries.begin());
+            }
+            csrTargets = targets.data();
+            csrWeights = weights.data();
+            if (oldWeight == 0) zeroWeightEntries -= (int)entries.size();
+        } else {
+            edgeList[index].weight = newWeight;
+            for (int k = 0; k < (int)entries.size(); k++) weights[entries[k]] = newWeight;
+            maxWeight = max(maxWeight, newWeight);
+            if (oldWeight == 0) zeroWeightEntries -= (int)entries.size();
+            if (newWeight == 0) zeroWeightEntries += (int)entries.size();
+        }
+
+        if (u != v) {
+            for (map<VertexId, ShortestPathTree>::iterator it = treeCache.begin(); it != treeCache.end(); ++it) {
+                repairTree(it->second, it->first, u, v, oldWeight, newWeight, removed);
+            }
+        }
+        return true;
+    }
+
+public:
+    Graph() {
+        numNodes = 0;
+        maxWeight = 0;
+        zeroWeightEntries = 0;
+        csrValid = false;
+        csrOffsets = NULL;
+        csrTargets = NULL;
+        csrWeights = NULL;
+        snapshot = NULL;
+        queueKind = BINARY_HEAP;
+        deltaWidth = 0;
+        numThreads = max(1, (int)thread::hardware_concurrency());
+    }
+
+    // Serve the graph straight from a mapped snapshot, which must outlive
+    // it. Nothing is copied: the CSR arrays and names are read in place,
+    // and the snapshot's cached tree is used the first time its capital
+    // is asked for.
+    void attachSnapshot(const GraphSnapshot& mapped) {
+        edgeList.clear();
+        treeCache.clear();
+        snapshot = &mapped;
+        dictionary.attach(&mapped);
+        numNodes = (int)mapped.getNumNodes();
+        maxWeight = mapped.getMaxWeight();
+        zeroWeightEntries = -1;
+        csrOffsets = mapped.getOffsets();
+        csrTargets = mapped.getTargets();
+        csrWeights = mapped.getWeights();
+        csrValid = true;
+    }
+
+    // Write the graph, plus the shortest-path tree from capital, as a snapshot
+    bool writeSnapshot(const string& fileName, VertexId capital) {
+        const ShortestPathTree& tree = getTree(capital);
+        vector<string> names(numNodes);
+        for (int i = 0; i < numNodes; i++) names[i] = dictionary.name(i).str();
+        return writeGraphSnapshot(fileName, names, csrOffsets, csrTargets, csrWeights, maxWeight,
+                                  capital, tree.dist.data(), tree.parent.data());
+    }
+    
+    void addEdge(const string& u, const string& v, int weight) {
+        detachSnapshot();
+        VertexId uId = dictionary.getOrAdd(u);
+        VertexId vId = dictionary.getOrAdd(v);
+        numNodes = dictionary.size();
+
+        edgeList.push_back(Edge(uId, vId, weight));
+        csrValid = false;
+
+        // Any new edge can change shortest paths, so drop cached trees
+        treeCache.clear();
+    }
+    
+    // Change the weight of road u - v (the first in input order if there
+    // are parallel roads). Cached trees are repaired rather than dropped.
+    // Returns false if there is no such road.
+    bool updateEdgeWeight(const string& u, const string& v, int weight) {
+        return changeEdge(dictionary.find(u), dictionary.find(v), weight, false);
+    }
+
+    // Remove road u - v (the first in input order), repairing cached trees;
+    // the cities stay. Returns false if there is no such road.
+    bool removeEdge(const string& u, const string& v) {
+        return changeEdge(dictionary.find(u), dictionary.find(v), 0, true);
+    }
+    
+    int getNumNodes() const { return numNodes; }
+    
+    const VertexDictionary& getDictionary() const { return dictionary; }
+
+    VertexId findVertex(const string& name) const { return dictionary.find(name); }
+
+    // Read-only CSR arrays (built on demand) for engines that walk the graph directly
+    const uint32_t* getOffsets() { ensureCSR(); return csrOffsets; }
+    const VertexId* getTargets() { ensureCSR(); return csrTargets; }
+    const int* getWeights() { ensureCSR(); return csrWeights; }
+    
+    // Pick the priority queue used by Dijkstra. Radix and Dial queues need
+    // non-negative integer weights (which Dijkstra assumes anyway). Every
+    // queue builds the same tree, since parents follow tightParent.
+    void setQueueKind(QueueKind kind) {
+        if (kind != queueKind) {
+            queueKind = kind;
+            treeCache.clear();
+        }
+    }
+
+    // Delta-stepping tuning: bucket width (0 = average edge weight)
+    void setDeltaWidth(int width) {
+        deltaWidth = width < 0 ? 0 : width;
+        treeCache.clear();
+    }
+
+    // Threads used by delta-stepping (at least 1)
+    void setNumThreads(int threads) {
+        numThreads = threads < 1 ? 1 : threads;
+    }
+
+    // Forget every cached shortest-path tree, so the next query per capital
+    // runs Dijkstra again (benchmarks use this to time cold queries)
+    void clearTreeCache() { treeCache.clear(); }
+
+    // Checksum of the CSR arrays, so indexes built from this graph can
+    // tell when they are loaded against a different one
+    uint64_t fingerprint() {
+        ensureCSR();
+        uint64_t h = snapshotChecksum((const char*)csrOffsets, (numNodes + 1) * sizeof(uint32_t));
+        uint32_t m = csrOffsets[numNodes];
+        h ^= snapshotChecksum((const char*)csrTargets, m * sizeof(VertexId)) * 31;
+        h ^= snapshotChecksum((const char*)csrWeights, m * sizeof(int)) * 17;
+        return h;
+    }
+
+    // Dijkstra's algorithm implementation - returns distances and parent pointers
+    pair<vector<int>, vector<int> > dijkstraWithParents(VertexId start) {
+        ensureCSR();
+        switch (queueKind) {
+        case RADIX_HEAP:
+            return dijkstraWithQueue<RadixHeapQueue>(start);
+        case DIAL_BUCKETS:
+            return dijkstraWithQueue<DialQueue>(start);
+        case DELTA_STEPPING:
+            return deltaStepping(start);
+        default:
+            return dijkstraWithQueue<BinaryHeapQueue>(start);
+        }
+    }
+
+    template <class Queue>
+    pair<vector<int>, vector<int> > dijkstraWithQueue(VertexId start) {
+        ensureCSR();
+        vector<int> dist(numNodes, INT_MAX);
+        vector<int> parent(numNodes, -1);
+        Queue pq(maxWeight);
+
+        dist[start] = 0;
+        pq.push(0, (int)start);
+
+        const uint32_t* off = csrOffsets;
+        const VertexId* tgt = csrTargets;
+        const int* wt = csrWeights;
+
+        while (!pq.empty()) {
+            pair<int, int> top = pq.pop();
+            int d = top.first;
+            int u = top.second;
+
+            if (d > dist[u]) continue;
+
+            for (uint32_t e = off[u]; e < off[u + 1]; e++) {
+                VertexId v = tgt[e];
+                int newDist = d + wt[e];
+
+                if (newDist < dist[v]) {
+                    dist[v] = newDist;
+                    pq.push(newDist, (int)v);
+                }
+            }
+        }
+
+        // Which tied neighbour relaxed v first depends on the queue, so
+        // parents are chosen afterwards by the shared rule
+        assignParents(dist, start, parent);
+        return make_pair(dist, parent);
+    }
+
+    // Delta-stepping (Meyer & Sanders): tentative distances are kept in
+    // buckets of width delta. The lowest non-empty bucket is emptied by
+    // repeatedly relaxing the light edges (weight <= delta) of its vertices,
+    // which can only refill that same bucket; then the heavy edges of
+    // everything settled in it are relaxed once. Every phase splits its
+    // frontier across a fixed team of threads that lower distances with an
+    // atomic compare-and-swap; thread 0 refills the buckets between
+    // barriers. Live distances span at most maxWeight, so the buckets form
+    // a ring of maxWeight / delta + 2 slots.
+    //
+    // The race decides which relaxation lands first, so parents are chosen
+    // afterwards by the tightParent rule (in parallel here) and
+    // placeZeroWeightTies. The tree is therefore the same for any thread
+    // count, and the same as the other queues build.
+    pair<vector<int>, vector<int> > deltaStepping(VertexId start) {
+        ensureCSR();
+        int n = numNodes;
+        long long delta = deltaWidth;
+        if (delta <= 0) {
+            long long total = 0;
+            uint32_t m = csrOffsets[n];
+            for (uint32_t e = 0; e < m; e++) total += csrWeights[e];
+            delta = m > 0 ? max(1LL, total / m) : 1;
+        }
+        delta = max(delta, (long long)maxWeight / (1 << 20) + 1);  // keep the ring small
+        int slots = (int)(maxWeight / delta + 2);
+        int threads = numThreads;
+
+        vector<atomic<int> > dist(n);
+        for (int v = 0; v < n; v++) dist[v].store(INT_MAX, memory_order_relaxed);
+        dist[start].store(0, memory_order_relaxed);
+        vector<vector<VertexId> > ring(slots);
+        ring[0].push_back(start);
+        vector<vector<VertexId> > improved(threads);
+        vector<VertexId> frontier, settled;
+        vector<int> frontierStamp(n, -1), settledStamp(n, -1);
+        long long current = 0;
+        int stamp = 0, round = 0;   // round counts buckets, for settledStamp
+        bool lightPhase = true, done = false;
+        RoundBarrier barrier(threads);
+
+        const uint32_t* off = csrOffsets;
+        const VertexId* tgt = csrTargets;
+        const int* wt = csrWeights;
+
+        // Thread 0, between phases: file improved vertices into buckets and
+        // pick the next frontier (returns false when everything is settled)
+        auto nextPhase = [&]() -> bool {
+            for (int t = 0; t < threads; t++) {
+                for (int i = 0; i < (int)improved[t].size(); i++) {
+                    VertexId v = improved[t][i];
+                    ring[(dist[v].load(memory_order_relaxed) / delta) % slots].push_back(v);
+                }
+                improved[t].clear();
+            }
+            while (true) {
+                if (lightPhase) {
+                    vector<VertexId> bucket;
+                    bucket.swap(ring[current % slots]);
+                    frontier.clear();
+                    stamp++;
+                    for (int i = 0; i < (int)bucket.size(); i++) {
+                        VertexId v = bucket[i];
+                        if (dist[v].load(memory_order_relaxed) / delta != current || frontierStamp[v] == stamp) continue;
+                        frontierStamp[v] = stamp;
+                        frontier.push_back(v);
+                        if (settledStamp[v] != round) {
+                            settledStamp[v] = round;
+                            settled.push_back(v);
+                        }
+                    }
+                    if (!frontier.empty()) return true;
+                    // Bucket emptied: relax heavy edges of what it settled
+                    lightPhase = false;
+                    frontier.swap(settled);
+                    settled.clear();
+                    if (!frontier.empty()) return true;
+                }
+                // Heavy phase finished: move on to the next non-empty bucket
+                lightPhase = true;
+                round++;
+                int scanned = 0;
+                do {
+                    current++;
+                    scanned++;
+                } while (ring[current % slots].empty() && scanned <= slots);
+                if (ring[current % slots].empty()) return false;
+            }
+        };
+
+        vector<int> parent(n, -1);
+        auto worker = [&](int t) {
+            while (true) {
+                if (t == 0) done = !nextPhase();
+                barrier.wait();
+                if (done) break;
+                size_t lo = frontier.size() * t / threads, hi = frontier.size() * (t + 1) / threads;
+                for (size_t i = lo; i < hi; i++) {
+                    VertexId u = frontier[i];
+                    int du = dist[u].load(memory_order_relaxed);
+                    for (uint32_t e = off[u]; e < off[u + 1]; e++) {
+                        if ((wt[e] <= delta) != lightPhase) continue;
+                        int newDist = du + wt[e];
+                        VertexId v = tgt[e];
+                        int old = dist[v].load(memory_order_relaxed);
+                        while (newDist < old) {
+                            if (dist[v].compare_exchange_weak(old, newDist, memory_order_relaxed)) {
+                                improved[t].push_back(v);
+                                break;
+                            }
+                        }
+                    }
+                }
+                barrier.wait();
+            }
+
+            // Deterministic parents, one slice of vertices per thread
+            int lo = (int)((long long)n * t / threads), hi = (int)((long long)n * (t + 1) / threads);
+            for (int v = lo; v < hi; v++) {
+                int dv = dist[v].load(memory_order_relaxed);
+                if (v == (int)start || dv == INT_MAX) continue;
+                for (uint32_t e = off[v]; e < off[v + 1]; e++) {
+                    int du = dist[tgt[e]].load(memory_order_relaxed);
+                    if (du < dv && du + wt[e] == dv) {
+                        parent[v] = tgt[e];
+                        break;
+                    }
+                }
+            }
+        };
+        vector<thread> team;
+        for (int t = 1; t < threads; t++) team.push_back(thread(worker, t));
+        worker(0);
+        for (int t = 0; t < (int)team.size(); t++) team[t].join();
+
+        vector<int> result(n);
+        for (int v = 0; v < n; v++) result[v] = dist[v].load(memory_order_relaxed);
+
+        placeZeroWeightTies(result, start, parent);
+        return make_pair(result, parent);
+    }
+
+    // Get the shortest-path tree from capital, running Dijkstra only the
+    // first time this capital is asked for (or after the graph changed)
+    const ShortestPathTree& getTree(VertexId capital) {
+        map<VertexId, ShortestPathTree>::iterator it = treeCache.find(capital);
+        if (it == treeCache.end() && snapshot != NULL && snapshot->hasTree() && snapshot->getTreeSource() == capital) {
+            ShortestPathTree& tree = treeCache[capital];
+            tree.dist.assign(snapshot->getTreeDist(), snapshot->getTreeDist() + numNodes);
+            tree.parent.assign(snapshot->getTreeParent(), snapshot->getTreeParent() + numNodes);
+            return tree;
+        }
+        if (it == treeCache.end()) {
+            pair<vector<int>, vector<int> > result = dijkstraWithParents(capital);
+            ShortestPathTree& tree = treeCache[capital];
+            tree.dist.swap(result.first);
+            tree.parent.swap(result.second);
+            return tree;
+        }
+        return it->second;
+    }
+
+    // Vertices on the tree path from root down to v, both ends included
+    static size_t treePathLength(const vector<int>& parent, VertexId root, VertexId v) {
+        size_t length = 1;
+        for (int curr = v; curr != (int)root; curr = parent[curr]) length++;
+        return length;
+    }
+
+    // Path start -> ... -> capital -> ... -> end written straight into out,
+    // which holds exactly length vertices. Climbing from start already
+    // gives the first half in order, and the climb from end fills the
+    // second half from the back, so nothing is reversed or spliced.
+    static void writePathViaCapital(const vector<int>& parent, VertexId startIdx, VertexId endIdx,
+                                    VertexId capitalIdx, VertexId* out, size_t length) {
+        size_t front = 0, back = length;
+        for (int curr = startIdx; curr != (int)capitalIdx; curr = parent[curr]) out[front++] = curr;
+        for (int curr = endIdx; curr != (int)capitalIdx; curr = parent[curr]) out[--back] = curr;
+        out[front] = capitalIdx;
+    }
+
+    // The path lives in arena until it is cleared
+    PathResult shortestPathViaCapital(VertexId startIdx, VertexId endIdx, VertexId capitalIdx,
+                                      PathArena<VertexId>& arena) {
+        return pathInTree(getTree(capitalIdx), startIdx, endIdx, capitalIdx, arena);
+    }
+
+    // Algorithm 1 answer read from an already computed tree (safe to call
+    // from many threads at once, each with its own arena)
+    PathResult pathInTree(const ShortestPathTree& tree, VertexId startIdx, VertexId endIdx, VertexId capitalIdx,
+                          PathArena<VertexId>& arena) const {
+        const vector<int>& distFromCapital = tree.dist;
+        if (distFromCapital[startIdx] == INT_MAX || distFromCapital[endIdx] == INT_MAX) {
+            return make_pair(-1, VertexPath());
+        }
+        int totalDist = distFromCapital[startIdx] + distFromCapital[endIdx];
+        size_t length = treePathLength(tree.parent, capitalIdx, startIdx) +
+                        treePathLength(tree.parent, capitalIdx, endIdx) - 1;
+        VertexId* out = arena.allocate(length);
+        writePathViaCapital(tree.parent, startIdx, endIdx, capitalIdx, out, length);
+        return make_pair(totalDist, VertexPath(out, length));
+    }
+
+    // Answer many (capital, start, end) triples. Queries are grouped by
+    // capital; every distinct capital gets one Dijkstra on the pool, then
+    // its answers are split into chunks that idle workers can steal.
+    // Results are in input order, and the trees land in the tree cache.
+    // A first pass measures every path, so all of them are written into
+    // one slice of arena taken up front: the batch allocates the same
+    // handful of buffers however many queries it has.
+    vector<PathResult> batchShortestPaths(const vector<RouteQuery>& queries, int threads, PathArena<VertexId>& arena) {
+        ensureCSR();
+        vector<PathResult> results(queries.size(), PathResult(-1, VertexPath()));
+        vector<size_t> slots(queries.size(), 0);  // path length, then its offset in the slice
+        map<VertexId, vector<int> > groups;
+        for (int i = 0; i < (int)queries.size(); i++) {
+            const RouteQuery& q = queries[i];
+            if (q.capital < (VertexId)numNodes && q.from < (VertexId)numNodes && q.to < (VertexId)numNodes) {
+                groups[q.capital].push_back(i);
+            }
+        }
+
+        // Capitals already in the tree cache are answered from there
+        vector<VertexId> capitals;
+        vector<const vector<int>*> members;
+        vector<ShortestPathTree> trees(groups.size());
+        vector<const ShortestPathTree*> treeFor;
+        for (map<VertexId, vector<int> >::iterator it = groups.begin(); it != groups.end(); ++it) {
+            map<VertexId, ShortestPathTree>::iterator cached = treeCache.find(it->first);
+            if (cached == treeCache.end() && snapshot != NULL && snapshot->hasTree() && snapshot->getTreeSource() == it->first) {
+                getTree(it->first);
+                cached = treeCache.find(it->first);
+            }
+            treeFor.push_back(cached != treeCache.end() ? &cached->second : &trees[capitals.size()]);
+            capitals.push_back(it->first);
+            members.push_back(&it->second);
+        }
+
+        const int chunk = 256;
+        WorkStealingPool pool(threads);
+        for (int c = 0; c < (int)capitals.size(); c++) {
+            pool.submit([&, c]() {
+                if (treeFor[c] == &trees[c]) {
+                    pair<vector<int>, vector<int> > result = dijkstraWithParents(capitals[c]);
+                    trees[c].dist.swap(result.first);
+                    trees[c].parent.swap(result.second);
+                }
+                const vector<int>& group = *members[c];
+                for (int lo = 0; lo < (int)group.size(); lo += chunk) {
+                    pool.submit([&, c, lo]() {
+                        const vector<int>& ids = *members[c];
+                        int hi = min((int)ids.size(), lo + chunk);
+                        const ShortestPathTree& tree = *treeFor[c];
+                        for (int i = lo; i < hi; i++) {
+                            const RouteQuery& q = queries[ids[i]];
+                            if (tree.dist[q.from] == INT_MAX || tree.dist[q.to] == INT_MAX) continue;
+                            results[ids[i]].first = tree.dist[q.from] + tree.dist[q.to];
+                            slots[ids[i]] = treePathLength(tree.parent, q.capital, q.from) +
+                                            treePathLength(tree.parent, q.capital, q.to) - 1;
+                        }
+                    });
+                }
+            });
+        }
+        pool.run();
+
+        size_t total = 0;
+        for (int i = 0; i < (int)slots.size(); i++) {
+            size_t length = slots[i];
+            slots[i] = total;
+            total += length;
+        }
+        VertexId* slice = arena.allocate(total);
+        for (int c = 0; c < (int)capitals.size(); c++) {
+            for (int lo = 0; lo < (int)members[c]->size(); lo += chunk) {
+                pool.submit([&, c, lo]() {
+                    const vector<int>& ids = *members[c];
+                    int hi = min((int)ids.size(), lo + chunk);
+                    for (int i = lo; i < hi; i++) {
+                        int id = ids[i];
+                        if (results[id].first == -1) continue;
+                        size_t length = (id + 1 < (int)slots.size() ? slots[id + 1] : total) - slots[id];
+                        const RouteQuery& q = queries[id];
+                        writePathViaCapital(treeFor[c]->parent, q.from, q.to, q.capital, slice + slots[id], length);
+                        results[id].second = VertexPath(slice + slots[id], length);
+                    }
+                });
+            }
+        }
+        pool.run();
+
+        for (int c = 0; c < (int)capitals.size(); c++) {
+            if (treeFor[c] == &trees[c]) swap(treeCache[capitals[c]], trees[c]);
+        }
+        return results;
+    }
+    
+    // Label every vertex with the capital-child subtree it hangs under.
+    // Each vertex climbs parent pointers only until it meets a labeled one,
+    // so the whole pass is O(n).
+    void labelSubtrees(ShortestPathTree& tree, VertexId capital) {
+        vector<int>& label = tree.subtree;
+        label.assign(numNodes, -1);
+        label[capital] = capital;
+
+        vector<int> chain;
+        for (int v = 0; v < numNodes; v++) {
+            if (tree.dist[v] == INT_MAX || label[v] != -1) continue;
+
+            int curr = v;
+            while (label[curr] == -1) {
+                chain.push_back(curr);
+                curr = tree.parent[curr];
+            }
+            // The last vertex pushed is a child of the capital if we stopped there
+            int lab = (curr == (int)capital) ? chain.back() : label[curr];
+            for (int i = 0; i < (int)chain.size(); i++) {
+                label[chain[i]] = lab;
+            }
+            chain.clear();
+        }
+    }
+
+    const ShortestPathTree& getLabeledTree(VertexId capital) {
+        getTree(capital);
+        ShortestPathTree& tree = treeCache[capital];
+        if (tree.subtree.empty()) labelSubtrees(tree, capital);
+        return tree;
+    }
+
+    // Algorithm 2 distance for one pair in O(1): the two tree paths from the
+    // capital are vertex-disjoint exactly when u and v sit under different
+    // children of the capital. Returns -1 if there is no valid path.
+    int viaCapitalDistanceAlg2(VertexId u, VertexId v, VertexId capital) {
+        const ShortestPathTree& tree = getLabeledTree(capital);
+        if (tree.subtree[u] == -1 || tree.subtree[v] == -1 || tree.subtree[u] == tree.subtree[v]) {
+            return -1;
+        }
+        return tree.dist[u] + tree.dist[v];
+    }
+
+    // Algorithm 2 for one pair; the path is only built when it is valid
+    PathResult shortestPathViaCapitalAlg2(VertexId u, VertexId v, VertexId capital, PathArena<VertexId>& arena) {
+        if (viaCapitalDistanceAlg2(u, v, capital) == -1) {
+            return make_pair(-1, VertexPath());
+        }
+        return shortestPathViaCapital(u, v, capital, arena);
+    }
+
+    // Stream Algorithm 2 over all ordered pairs (u, v) with u != v and neither
+    // being the capital, calling visit(u, v, distance) for each one
+    // (distance is -1 when there is no valid path). Nothing is stored, so
+    // memory stays O(n). Returns the number of pairs visited.
+    template <class Visitor>
+    long long allPairsViaCapitalAlg2(VertexId capitalIdx, Visitor visit) {
+        const ShortestPathTree& tree = getLabeledTree(capitalIdx);
+        const vector<int>& dist = tree.dist;
+        const vector<int>& label = tree.subtree;
+        long long pairs = 0;
+
+        for (VertexId uIdx = 0; uIdx < (VertexId)numNodes; uIdx++) {
+            if (uIdx == capitalIdx) continue;
+            for (VertexId vIdx = 0; vIdx < (VertexId)numNodes; vIdx++) {
+                if (vIdx == capitalIdx || vIdx == uIdx) continue;
+
+                bool valid = label[uIdx] != -1 && label[vIdx] != -1 && label[uIdx] != label[vIdx];
+                visit(uIdx, vIdx, valid ? dist[uIdx] + dist[vIdx] : -1);
+                pairs++;
+            }
+        }
+
+        return pairs;
+    }
+    
+    void printPath(const VertexPath& path, ostream& out = cout) {
+        for (int i = 0; i < (int)path.size(); i++) {
+            out << dictionary.name(path[i]);
+            if (i < (int)path.size() - 1) out << ", ";
+        }
+    }
+    
+    void printGraph() {
+        ensureCSR();
+        cout << "Graph with " << numNodes << " nodes:" << endl;
+        for (int u = 0; u < numNodes; u++) {
+            cout << "Node " << dictionary.name(u) << " -> ";
+            for (uint32_t e = csrOffsets[u]; e < csrOffsets[u + 1]; e++) {
+                cout << dictionary.name(csrTargets[e]) << "(" << csrWeights[e] << ")";
+                if (e + 1 < csrOffsets[u + 1]) cout << ", ";
+            }
+            cout << endl;
+        }
+    }
+};
+
+// Algorithm 3: exact minimum-cost vertex-disjoint route u -> capital -> v.
+// Every vertex x is split into in(x) -> out(x) with capacity 1, and two
+// units of flow are sent from the capital to a sink fed by u and v
+// (Suurballe's two-path successive shortest paths). The capital's cached
+// shortest-path tree gives both the first augmenting path and potentials
+// that keep every residual arc non-negative, so a query costs a single
+// early-exit Dijkstra on the residual graph. Scratch arrays are sized once
+// and only the entries a query touched are reset afterwards.
+class DisjointPathRouter {
+private:
+    Graph& g;
+    VertexId capital;
+    int n;
+
+    // First augmenting path (tree path capital -> first target)
+    vector<int> pathPrev;        // predecessor on the path, -1 if not on it
+    vector<uint32_t> pathEdge;   // CSR edge entering the vertex on the path
+    vector<char> canceled;       // path edge into the vertex was undone
+    vector<int> pathVertices;
+
+    // Residual Dijkstra over split states: in(x) = 2x, out(x) = 2x+1, sink = 2n
+    vector<int> dist;
+    vector<int> prevState;
+    vector<uint32_t> prevEdge;
+    vector<int> touched;
+
+    // Final flow: succ[x] is where the flow leaves x (capital has two)
+    vector<int> succ;
+    vector<int> succTouched;
+
+    static const uint32_t NO_EDGE = UINT32_MAX;
+
+    void resize() {
+        n = g.getNumNodes();
+        pathPrev.assign(n, -1);
+        pathEdge.assign(n, NO_EDGE);
+        canceled.assign(n, 0);
+        dist.assign(2 * n + 1, INT_MAX);
+        prevState.assign(2 * n + 1, -1);
+        prevEdge.assign(2 * n + 1, NO_EDGE);
+        succ.assign(n, -1);
+    }
+
+    void relax(int from, int to, uint32_t edge, int newDist,
+               priority_queue<pair<int, int>, vector<pair<int, int> >, greater<pair<int, int> > >& pq) {
+        if (newDist < dist[to]) {
+            if (dist[to] == INT_MAX) touched.push_back(to);
+            dist[to] = newDist;
+            prevState[to] = from;
+            prevEdge[to] = edge;
+            pq.push(make_pair(newDist, to));
+        }
+    }
+
+    void reset() {
+        for (int i = 0; i < (int)pathVertices.size(); i++) {
+            pathPrev[pathVertices[i]] = -1;
+            pathEdge[pathVertices[i]] = NO_EDGE;
+            canceled[pathVertices[i]] = 0;
+        }
+        pathVertices.clear();
+        for (int i = 0; i < (int)touched.size(); i++) {
+            dist[touched[i]] = INT_MAX;
+            prevState[touched[i]] = -1;
+            prevEdge[touched[i]] = NO_EDGE;
+        }
+        touched.clear();
+        for (int i = 0; i < (int)succTouched.size(); i++) {
+            succ[succTouched[i]] = -1;
+        }
+        succTouched.clear();
+    }
+
+public:
+    DisjointPathRouter(Graph& graph, VertexId capital) : g(graph) {
+        this->capital = capital;
+        n = -1;
+    }
+
+    PathResult route(VertexId u, VertexId v, PathArena<VertexId>& arena) {
+        const ShortestPathTree& tree = g.getTree(capital);
+        const vector<int>& d = tree.dist;
+        const uint32_t* off = g.getOffsets();
+        const VertexId* tgt = g.getTargets();
+        const int* wt = g.getWeights();
+        if (n != g.getNumNodes()) resize();
+
+        if (u == v || u == capital || v == capital || d[u] == INT_MAX || d[v] == INT_MAX) {
+            return make_pair(-1, VertexPath());
+        }
+
+        // First augmentation: the tree path to the nearer endpoint
+        VertexId first = d[u] <= d[v] ? u : v;
+        VertexId second = first == u ? v : u;
+        for (int x = first; x != (int)capital; x = tree.parent[x]) {
+            int p = tree.parent[x];
+            uint32_t e = off[p];
+            while (tgt[e] != (VertexId)x || wt[e] != d[x] - d[p]) e++;
+            pathPrev[x] = p;
+            pathEdge[x] = e;
+            pathVertices.push_back(x);
+        }
+
+        // Second augmentation: Dijkstra on the residual graph with reduced
+        // costs c(a, b) + pi(a) - pi(b), where pi(in x) = pi(out x) = d[x]
+        // and pi(sink) = d[first]
+        int sink = 2 * n;
+        int sinkPotential = d[first];
+        priority_queue<pair<int, int>, vector<pair<int, int> >, greater<pair<int, int> > > pq;
+        int source = 2 * capital + 1;
+        dist[source] = 0;
+        touched.push_back(source);
+        pq.push(make_pair(0, source));
+
+        while (!pq.empty()) {
+            int du = pq.top().first;
+            int state = pq.top().second;
+            pq.pop();
+            if (du > dist[state]) continue;
+            if (state == sink) break;
+
+            int x = state / 2;
+            if (state % 2 == 1) {
+                // out(x): graph edges that are not already carrying flow
+                for (uint32_t e = off[x]; e < off[x + 1]; e++) {
+                    VertexId y = tgt[e];
+                    if (y == capital || pathEdge[y] == e) continue;
+                    relax(state, 2 * y, e, du + wt[e] + d[x] - d[y], pq);
+                }
+                // Undo the in(x) -> out(x) flow of the first path
+                if (pathPrev[x] != -1) relax(state, 2 * x, NO_EDGE, du, pq);
+                if (x == (int)second) relax(state, sink, NO_EDGE, du + d[x] - sinkPotential, pq);
+            } else {
+                if (pathPrev[x] == -1) {
+                    if (x != (int)capital) relax(state, state + 1, NO_EDGE, du, pq);
+                } else {
+                    // Undo the first path's edge into x (reduced cost is 0 on a tree edge)
+                    relax(state, 2 * pathPrev[x] + 1, pathEdge[x], du, pq);
+                }
+            }
+        }
+
+        if (dist[sink] == INT_MAX) {
+            reset();
+            return make_pair(-1, VertexPath());
+        }
+
+        // Combine both paths: second-path edges add flow, reverse moves cancel it
+        int capitalSucc[2];
+        int numSucc = 0;
+        int totalDist = 0;
+        for (int state = sink; state != source; state = prevState[state]) {
+            int from = prevState[state];
+            if (from % 2 == 1 && state % 2 == 0 && prevEdge[state] != NO_EDGE) {
+                int x = from / 2, y = state / 2;
+                totalDist += wt[prevEdge[state]];
+                if (x == (int)capital) capitalSucc[numSucc++] = y;
+                else { succ[x] = y; succTouched.push_back(x); }
+            } else if (from % 2 == 0 && state % 2 == 1 && prevEdge[state] != NO_EDGE) {
+                canceled[from / 2] = 1;
+            }
+        }
+        for (int i = 0; i < (int)pathVertices.size(); i++) {
+            int y = pathVertices[i];
+            if (canceled[y]) continue;
+            int x = pathPrev[y];
+            totalDist += wt[pathEdge[y]];
+            if (x == (int)capital) capitalSucc[numSucc++] = y;
+            else { succ[x] = y; succTouched.push_back(x); }
+        }
+
+        // Follow each unit of flow out of the capital to its endpoint. The
+        // chain ending at u is written backwards in front of the capital.
+        size_t lengths[2] = {0, 0};
+        int last[2] = {-1, -1};
+        for (int c = 0; c < 2; c++) {
+            for (int x = capitalSucc[c]; x != -1; x = succ[x]) {
+                lengths[c]++;
+                last[c] = x;
+            }
+        }
+        int toStart = last[0] == (int)u ? 0 : 1;
+        size_t length = lengths[0] + lengths[1] + 1;
+        VertexId* out = arena.allocate(length);
+        size_t pos = lengths[toStart];
+        out[pos] = capital;
+        for (int x = capitalSucc[toStart]; x != -1; x = succ[x]) out[--pos] = x;
+        pos = lengths[toStart] + 1;
+        for (int x = capitalSucc[1 - toStart]; x != -1; x = succ[x]) out[pos++] = x;
+
+        reset();
+        return make_pair(totalDist, VertexPath(out, length));
+    }
+};
+
+const uint32_t DisjointPathRouter::NO_EDGE;
+
+// Contraction hierarchy for plain s -> t queries. Preprocessing contracts
+// the vertices one at a time, least important first (see importance(),
+// re-evaluated lazily). When v is contracted, each pair of its remaining
+// neighbours u, w gets a shortcut of weight d(u,v) + d(v,w), unless a
+// witness search finds a path that is no longer. The witness search is a
+// Dijkstra from u that avoids v and stops after WITNESS_SETTLE_LIMIT
+// vertices. Afterwards every edge points from its lower-ranked end to its
+// higher-ranked one. The graph is undirected, so this single upward CSR is
+// also the downward graph, read backwards from t. A query is a
+// bidirectional Dijkstra that only climbs, with stall-on-demand pruning.
+// Shortcuts are unpacked through their middle vertex, whose own upward
+// edges reach both ends.
+class ContractionHierarchy {
+private:
+    struct ChEdge {
+        VertexId to;
+        int weight;
+        int middle;   // contracted vertex this shortcut bypasses, -1 for an original edge
+    };
+
+    static const int WITNESS_SETTLE_LIMIT = 500;
+    static const int ESTIMATE_SETTLE_LIMIT = 10;  // cheaper searches for priorities
+    static const uint32_t INDEX_VERSION = 1;
+
+    int n;
+    vector<int> rank;            // contraction order
+    vector<uint32_t> upOffsets;  // edges to higher-ranked vertices
+    vector<VertexId> upTargets;
+    vector<int> upWeights;
+    vector<int> upMiddle;
+    uint64_t graphFingerprint;
+    long long numShortcuts;
+
+    // Query scratch, reset through touched after every query
+    vector<int> dist[2];
+    vector<int> parent[2];
+    vector<uint32_t> parentEdge[2];
+    vector<int> touched;
+    vector<VertexId> chain[2];        // unpacked halves of the last path
+    vector<uint32_t> chainEdges;
+    vector<pair<pair<VertexId, VertexId>, int> > unpackStack;
+
+    // Witness search scratch, only used while building
+    vector<int> witness;
+    vector<int> witnessTouched;
+    vector<pair<int, int> > witnessHeap;
+
+    // Keep one edge per neighbour, with the smaller weight
+    static bool addOrImprove(vector<ChEdge>& list, VertexId to, int weight, int middle) {
+        for (int i = 0; i < (int)list.size(); i++) {
+            if (list[i].to == to) {
+                if (weight >= list[i].weight) return false;
+                list[i].weight = weight;
+                list[i].middle = middle;
+                return true;
+            }
+        }
+        ChEdge e;
+        e.to = to;
+        e.weight = weight;
+        e.middle = middle;
+        list.push_back(e);
+        return true;
+    }
+
+    // Shortcuts contracting v would need right now. With apply set they
+    // are added to the adjacency lists too. adj only holds live vertices.
+    int contractVertex(VertexId v, vector<vector<ChEdge> >& adj, bool apply) {
+        const vector<ChEdge>& live = adj[v];
+        int settleLimit = apply ? WITNESS_SETTLE_LIMIT : ESTIMATE_SETTLE_LIMIT;
+        // maxAfter[i]: heaviest edge to a later neighbour, which bounds the search from i
+        vector<int> maxAfter(live.size() + 1, 0);
+        for (int i = (int)live.size() - 1; i >= 0; i--) maxAfter[i] = max(maxAfter[i + 1], live[i].weight);
+
+        int shortcuts = 0;
+        for (int i = 0; i + 1 < (int)live.size(); i++) {
+            // Witness Dijkstra from live[i].to, skipping v, capped in distance and size
+            VertexId source = live[i].to;
+            int limit = live[i].weight + maxAfter[i + 1];
+            witness[source] = 0;
+            witnessTouched.push_back(source);
+            witnessHeap.push_back(make_pair(0, (int)source));
+            int settled = 0;
+            while (!witnessHeap.empty() && settled < settleLimit) {
+                pop_heap(witnessHeap.begin(), witnessHeap.end(), greater<pair<int, int> >());
+                pair<int, int> top = witnessHeap.back();
+                witnessHeap.pop_back();
+                if (top.first > witness[top.second]) continue;
+                if (top.first > limit) break;
+                settled++;
+                const vector<ChEdge>& out = adj[top.second];
+                for (int k = 0; k < (int)out.size(); k++) {
+                    VertexId x = out[k].to;
+                    if (x == v) continue;
+                    int nd = top.first + out[k].weight;
+                    if (nd < witness[x]) {
+                        if (witness[x] == INT_MAX) witnessTouched.push_back(x);
+                        witness[x] = nd;
+                        witnessHeap.push_back(make_pair(nd, (int)x));
+                        push_heap(witnessHeap.begin(), witnessHeap.end(), greater<pair<int, int> >());
+                    }
+                }
+            }
+            witnessHeap.clear();
+
+            for (int j = i + 1; j < (int)live.size(); j++) {
+                int via = live[i].weight + live[j].weight;
+                if (witness[live[j].to] <= via) continue;
+                shortcuts++;
+                if (apply) {
+                    addOrImprove(adj[live[i].to], live[j].to, via, (int)v);
+                    addOrImprove(adj[live[j].to], live[i].to, via, (int)v);
+                }
+            }
+            for (int k = 0; k < (int)witnessTouched.size(); k++) witness[witnessTouched[k]] = INT_MAX;
+            witnessTouched.clear();
+        }
+        return shortcuts;
+    }
+
+    // Contraction priority, lowest first: edge difference (shortcuts added
+    // minus edges removed), plus contracted neighbours and level (one more
+    // than the highest contracted neighbour's), which spread contraction
+    // evenly over the graph
+    int importance(VertexId v, vector<vector<ChEdge> >& adj, const vector<int>& contractedNeighbours,
+                   const vector<int>& level) {
+        int edgeDifference = contractVertex(v, adj, false) - (int)adj[v].size();
+        return 2 * edgeDifference + contractedNeighbours[v] + level[v];
+    }
+
+    // Middle vertex of the upward edge low -> high
+    int middleOf(VertexId low, VertexId high) const {
+        for (uint32_t e = upOffsets[low]; e < upOffsets[low + 1]; e++) {
+            if (upTargets[e] == high) return upMiddle[e];
+        }
+        return -1;
+    }
+
+    // Append the original vertices strictly after a, up to and including b
+    void unpack(VertexId a, VertexId b, int middle, vector<VertexId>& out) {
+        vector<pair<pair<VertexId, VertexId>, int> >& stack = unpackStack;
+        stack.push_back(make_pair(make_pair(a, b), middle));
+        while (!stack.empty()) {
+            VertexId from = stack.back().first.first, to = stack.back().first.second;
+            int m = stack.back().second;
+            stack.pop_back();
+            if (m < 0) {
+                out.push_back(to);
+                continue;
+            }
+            // m ranks below both ends, so both halves are upward edges of m
+            stack.push_back(make_pair(make_pair((VertexId)m, to), middleOf(m, to)));
+            stack.push_back(make_pair(make_pair(from, (VertexId)m), middleOf(m, from)));
+        }
+    }
+
+    void prepareScratch() {
+        for (int side = 0; side < 2; side++) {
+            dist[side].assign(n, INT_MAX);
+            parent[side].assign(n, -1);
+            parentEdge[side].assign(n, 0);
+        }
+    }
+
+public:
+    ContractionHierarchy() : n(0), graphFingerprint(0), numShortcuts(0) {}
+
+    int getNumNodes() const { return n; }
+    long long getNumShortcuts() const { return numShortcuts; }
+    long long getNumUpEdges() const { return (long long)upTargets.size(); }
+
+    void build(Graph& g) {
+        n = g.getNumNodes();
+        graphFingerprint = g.fingerprint();
+        const uint32_t* off = g.getOffsets();
+        const VertexId* tgt = g.getTargets();
+        const int* wt = g.getWeights();
+
+        vector<vector<ChEdge> > adj(n);
+        for (int u = 0; u < n; u++) {
+            for (uint32_t e = off[u]; e < off[u + 1]; e++) {
+                if (tgt[e] != (VertexId)u) addOrImprove(adj[u], tgt[e], wt[e], -1);
+            }
+        }
+
+        vector<int> contractedNeighbours(n, 0), level(n, 0), priority(n);
+        witness.assign(n, INT_MAX);
+        priority_queue<pair<int, int>, vector<pair<int, int> >, greater<pair<int, int> > > order;
+        for (int v = 0; v < n; v++) {
+            priority[v] = importance(v, adj, contractedNeighbours, level);
+            order.push(make_pair(priority[v], v));
+        }
+
+        rank.assign(n, -1);
+        vector<vector<ChEdge> > up(n);
+        numShortcuts = 0;
+        int nextRank = 0;
+        while (!order.empty()) {
+            int v = order.top().second;
+            if (rank[v] != -1 || order.top().first != priority[v]) {
+                order.pop();  // stale entry
+                continue;
+            }
+            order.pop();
+
+            // Lazy update: re-evaluate, and put back if no longer the least important
+            int current = importance(v, adj, contractedNeighbours, level);
+            if (!order.empty() && current > order.top().first) {
+                priority[v] = current;
+                order.push(make_pair(current, v));
+                continue;
+            }
+
+            numShortcuts += contractVertex(v, adj, true);
+            up[v].swap(adj[v]);
+            rank[v] = nextRank++;
+            for (int i = 0; i < (int)up[v].size(); i++) {
+                // v leaves the remaining graph
+                VertexId w = up[v][i].to;
+                vector<ChEdge>& other = adj[w];
+                for (int k = 0; k < (int)other.size(); k++) {
+                    if (other[k].to == (VertexId)v) {
+                        other[k] = other.back();
+                        other.pop_back();
+                        break;
+                    }
+                }
+                contractedNeighbours[w]++;
+                level[w] = max(level[w], level[v] + 1);
+            }
+            for (int i = 0; i < (int)up[v].size(); i++) {
+                VertexId w = up[v][i].to;
+                priority[w] = importance(w, adj, contractedNeighbours, level);
+                order.push(make_pair(priority[w], (int)w));
+            }
+        }
+        vector<int>().swap(witness);
+
+        upOffsets.assign(n + 1, 0);
+        for (int v = 0; v < n; v++) upOffsets[v + 1] = upOffsets[v] + (uint32_t)up[v].size();
+        upTargets.resize(upOffsets[n]);
+        upWeights.resize(upOffsets[n]);
+        upMiddle.resize(upOffsets[n]);
+        for (int v = 0; v < n; v++) {
+            for (int i = 0; i < (int)up[v].size(); i++) {
+                uint32_t e = upOffsets[v] + i;
+                upTargets[e] = up[v][i].to;
+                upWeights[e] = up[v][i].weight;
+                upMiddle[e] = up[v][i].middle;
+            }
+        }
+        prepareScratch();
+    }
+
+    // Shortest s -> t path over the original graph (-1 if unreachable).
+    // The halves are unpacked into reused scratch, then copied once into arena.
+    PathResult query(VertexId s, VertexId t, PathArena<VertexId>& arena) {
+        if (s == t) return make_pair(0, arena.copy(&s, 1));
+        typedef priority_queue<pair<int, int>, vector<pair<int, int> >, greater<pair<int, int> > > Heap;
+        Heap heap[2];
+        VertexId ends[2] = {s, t};
+        for (int side = 0; side < 2; side++) {
+            dist[side][ends[side]] = 0;
+            touched.push_back(ends[side]);
+            heap[side].push(make_pair(0, (int)ends[side]));
+        }
+
+        long long best = LLONG_MAX;
+        int meet = -1;
+        while (!heap[0].empty() || !heap[1].empty()) {
+            int side = heap[1].empty() || (!heap[0].empty() && heap[0].top().first <= heap[1].top().first) ? 0 : 1;
+            pair<int, int> top = heap[side].top();
+            heap[side].pop();
+            if (top.first >= best) {
+                // Everything left on this side is at least as long as the best path
+                heap[side] = Heap();
+                continue;
+            }
+            int u = top.second;
+            if (top.first > dist[side][u]) continue;
+            if (dist[1 - side][u] != INT_MAX && (long long)top.first + dist[1 - side][u] < best) {
+                best = (long long)top.first + dist[1 - side][u];
+                meet = u;
+            }
+            // Stall-on-demand: a higher neighbour already reached more cheaply
+            // proves u's label is not a shortest distance, so don't expand it
+            bool stalled = false;
+            for (uint32_t e = upOffsets[u]; e < upOffsets[u + 1] && !stalled; e++) {
+                int above = dist[side][upTargets[e]];
+                stalled = above != INT_MAX && above + upWeights[e] < top.first;
+            }
+            if (stalled) continue;
+            for (uint32_t e = upOffsets[u]; e < upOffsets[u + 1]; e++) {
+                VertexId v = upTargets[e];
+                int nd = top.first + upWeights[e];
+                if (nd < dist[side][v]) {
+                    if (dist[0][v] == INT_MAX && dist[1][v] == INT_MAX) touched.push_back(v);
+                    dist[side][v] = nd;
+                    parent[side][v] = u;
+                    parentEdge[side][v] = e;
+                    heap[side].push(make_pair(nd, (int)v));
+                }
+            }
+        }
+
+        PathResult result(-1, VertexPath());
+        if (meet != -1) {
+            result.first = (int)best;
+            // s climbs to meet, and t climbs to meet (walked back the other way)
+            for (int side = 0; side < 2; side++) {
+                vector<uint32_t>& edges = chainEdges;
+                edges.clear();
+                for (int x = meet; x != (int)ends[side]; x = parent[side][x]) edges.push_back(parentEdge[side][x]);
+                chain[side].assign(1, ends[side]);
+                for (int i = (int)edges.size() - 1; i >= 0; i--) {
+                    VertexId low = chain[side].back();
+                    unpack(low, upTargets[edges[i]], upMiddle[edges[i]], chain[side]);
+                }
+            }
+            size_t length = chain[0].size() + chain[1].size() - 1;
+            VertexId* out = arena.allocate(length);
+            copy(chain[0].begin(), chain[0].end(), out);
+            reverse_copy(chain[1].begin(), chain[1].end() - 1, out + chain[0].size());
+            result.second = VertexPath(out, length);
+        }
+
+        for (int i = 0; i < (int)touched.size(); i++) {
+            for (int side = 0; side < 2; side++) {
+                dist[side][touched[i]] = INT_MAX;
+                parent[side][touched[i]] = -1;
+            }
+        }
+        touched.clear();
+        return result;
+    }
+
+    // Index file: magic, version, sizes, the graph's fingerprint, an FNV-1a
+    // checksum of the arrays, then rank and the upward CSR
+    bool save(const string& fileName) const {
+        vector<char> body;
+        snapshotAppend(body, rank.data(), rank.size() * sizeof(int));
+        snapshotAppend(body, upOffsets.data(), upOffsets.size() * sizeof(uint32_t));
+        snapshotAppend(body, upTargets.data(), upTargets.size() * sizeof(VertexId));
+        snapshotAppend(body, upWeights.data(), upWeights.size() * sizeof(int));
+        snapshotAppend(body, upMiddle.data(), upMiddle.size() * sizeof(int));
+        uint64_t header[6] = {0, INDEX_VERSION, (uint64_t)n, (uint64_t)upTargets.size(), graphFingerprint,
+                              snapshotChecksum(body.data(), body.size())};
+        memcpy(&header[0], "B2CHIDX1", 8);
+        ofstream out(fileName.c_str(), ios::binary);
+        if (!out.is_open()) return false;
+        out.write((const char*)header, sizeof(header));
+        out.write(body.data(), body.size());
+        return (bool)out;
+    }
+
+    // Fails with a message if the file is damaged or was built for another graph
+    bool load(const string& fileName, Graph& g, string& error) {
+        ifstream in(fileName.c_str(), ios::binary);
+        uint64_t header[6];
+        if (!in.is_open() || !in.read((char*)header, sizeof(header)) || memcmp(&header[0], "B2CHIDX1", 8) != 0) {
+            error = "not a contraction hierarchy index: " + fileName;
+            return false;
+        }
+        if (header[1] != INDEX_VERSION) {
+            error = "unsupported index version in " + fileName;
+            return false;
+        }
+        if (header[2] != (uint64_t)g.getNumNodes() || header[4] != g.fingerprint()) {
+            error = fileName + " was built for a different graph";
+            return false;
+        }
+        vector<char> body((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        n = (int)header[2];
+        size_t m = (size_t)header[3];
+        size_t sizes[5] = {n * sizeof(int), (n + 1) * sizeof(uint32_t), m * sizeof(VertexId), m * sizeof(int),
+                           m * sizeof(int)};
+        size_t expected = 0;
+        for (int i = 0; i < 5; i++) expected += snapshotAlign(sizes[i]);
+        if (body.size() != expected) {
+            error = "truncated index: " + fileName;
+            return false;
+        }
+        if (snapshotChecksum(body.data(), body.size()) != header[5]) {
+            error = "checksum mismatch in " + fileName;
+            return false;
+        }
+        const char* p = body.data();
+        rank.assign((const int*)p, (const int*)p + n);
+        p += snapshotAlign(sizes[0]);
+        upOffsets.assign((const uint32_t*)p, (const uint32_t*)p + n + 1);
+        p += snapshotAlign(sizes[1]);
+        upTargets.assign((const VertexId*)p, (const VertexId*)p + m);
+        p += snapshotAlign(sizes[2]);
+        upWeights.assign((const int*)p, (const int*)p + m);
+        p += snapshotAlign(sizes[3]);
+        upMiddle.assign((const int*)p, (const int*)p + m);
+        graphFingerprint = header[4];
+        numShortcuts = 0;
+        for (size_t e = 0; e < m; e++) numShortcuts += upMiddle[e] >= 0;
+        prepareScratch();
+        return true;
+    }
+};
+
+const int ContractionHierarchy::WITNESS_SETTLE_LIMIT;
+const int ContractionHierarchy::ESTIMATE_SETTLE_LIMIT;
+
+// Which min-plus kernel DenseAllPairs uses in this build
+string minPlusKernelName() {
+#if defined(__AVX512F__)
+    return "AVX-512";
+#elif defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE2__)
+    return "SSE2 (build with make SIMD=1 for AVX2/AVX-512)";
+#else
+    return "scalar (build with make SIMD=1 for SIMD)";
+#endif
+}
+
+// Dense all-pairs engine for regional graphs of a few thousand cities:
+// blocked Floyd-Warshall over flat n x n distance and next-hop matrices.
+// Round k works on one TILE-wide band. The diagonal tile goes first, then
+// the other tiles of its row and column, then every remaining tile, which
+// only reads the finished band. The last two steps are split across a
+// team of threads. Via-capital and direct distances, and the paths for
+// both, come out of the same two matrices.
+class DenseAllPairs {
+private:
+    static const int TILE = 64;  // 64 x 64 ints, 16 KB per tile
+
+    int n;
+    int stride;        // row length, n rounded up to a whole tile
+    vector<int> dist;  // dist[u * stride + v], UNREACHABLE when there is no path
+    vector<int> next;  // vertex after u on a shortest path to v
+    vector<uint32_t> offsets;  // copy of the graph, for appendTightPath
+    vector<VertexId> targets;
+    vector<int> weights;
+
+    // row[j] = min(row[j], dik + krow[j]) over one tile row, taking hop as
+    // the next hop wherever going through k is shorter. All inputs are at
+    // most UNREACHABLE, so the sum cannot overflow.
+    static void minPlusRow(int* row, int* hopRow, const int* krow, int dik, int hop) {
+#if defined(__AVX512F__)
+        __m512i d = _mm512_set1_epi32(dik), h = _mm512_set1_epi32(hop);
+        for (int j = 0; j < TILE; j += 16) {
+            __m512i candidate = _mm512_add_epi32(d, _mm512_loadu_si512((const void*)(krow + j)));
+            __mmask16 better = _mm512_cmpgt_epi32_mask(_mm512_loadu_si512((const void*)(row + j)), candidate);
+            _mm512_mask_storeu_epi32(row + j, better, candidate);
+            _mm512_mask_storeu_epi32(hopRow + j, better, h);
+        }
+#elif defined(__AVX2__)
+        __m256i d = _mm256_set1_epi32(dik), h = _mm256_set1_epi32(hop);
+        for (int j = 0; j < TILE; j += 8) {
+            __m256i current = _mm256_loadu_si256((const __m256i*)(row + j));
+            __m256i candidate = _mm256_add_epi32(d, _mm256_loadu_si256((const __m256i*)(krow + j)));
+            __m256i better = _mm256_cmpgt_epi32(current, candidate);
+            _mm256_storeu_si256((__m256i*)(row + j), _mm256_min_epi32(current, candidate));
+            __m256i hops = _mm256_loadu_si256((const __m256i*)(hopRow + j));
+            _mm256_storeu_si256((__m256i*)(hopRow + j), _mm256_blendv_epi8(hops, h, better));
+        }
+#elif defined(__SSE2__)
+        // No 32-bit min or blend before SSE4.1, so both are and/andnot masks
+        __m128i d = _mm_set1_epi32(dik), h = _mm_set1_epi32(hop);
+        for (int j = 0; j < TILE; j += 4) {
+            __m128i current = _mm_loadu_si128((const __m128i*)(row + j));
+            __m128i candidate = _mm_add_epi32(d, _mm_loadu_si128((const __m128i*)(krow + j)));
+            __m128i better = _mm_cmpgt_epi32(current, candidate);
+            _mm_storeu_si128((__m128i*)(row + j),
+                             _mm_or_si128(_mm_and_si128(better, candidate), _mm_andnot_si128(better, current)));
+            __m128i hops = _mm_loadu_si128((const __m128i*)(hopRow + j));
+            _mm_storeu_si128((__m128i*)(hopRow + j),
+                             _mm_or_si128(_mm_and_si128(better, h), _mm_andnot_si128(better, hops)));
+        }
+#else
+        for (int j = 0; j < TILE; j++) {
+            int candidate = dik + krow[j];
+            if (candidate < row[j]) {
+                row[j] = candidate;
+                hopRow[j] = hop;
+            }
+        }
+#endif
+    }
+
+    // Relax tile (ib, jb) through the vertices of band kb. k stays the
+    // outer loop, so this is also right when the tile is part of the band.
+    void relaxTile(int ib, int jb, int kb) {
+        int* d = dist.data();
+        int* hops = next.data();
+        for (int k = kb * TILE; k < (kb + 1) * TILE; k++) {
+            const int* krow = d + (size_t)k * stride + jb * TILE;
+            for (int i = ib * TILE; i < (ib + 1) * TILE; i++) {
+                size_t rowStart = (size_t)i * stride;
+                int dik = d[rowStart + k];
+                if (dik >= UNREACHABLE) continue;
+                minPlusRow(d + rowStart + jb * TILE, hops + rowStart + jb * TILE, krow, dik, hops[rowStart + k]);
+            }
+        }
+    }
+
+    // One team member's share of every round
+    void runRounds(int id, int threads, RoundBarrier& barrier) {
+        int tiles = stride / TILE;
+        for (int kb = 0; kb < tiles; kb++) {
+            if (id == 0) relaxTile(kb, kb, kb);
+            barrier.wait();
+            // Band: tile t < tiles-1 is in row kb, the rest in column kb
+            for (int t = id; t < 2 * (tiles - 1); t += threads) {
+                int other = t % (tiles - 1);
+                if (other >= kb) other++;
+                if (t < tiles - 1) relaxTile(kb, other, kb);
+                else relaxTile(other, kb, kb);
+            }
+            barrier.wait();
+            for (int t = id; t < (tiles - 1) * (tiles - 1); t += threads) {
+                int ib = t / (tiles - 1), jb = t % (tiles - 1);
+                if (ib >= kb) ib++;
+                if (jb >= kb) jb++;
+                relaxTile(ib, jb, kb);
+            }
+            barrier.wait();
+        }
+    }
+
+public:
+    // Distances at or above this are reported as no path
+    static const int UNREACHABLE = INT_MAX / 2;
+    // Largest graph build accepts: two 20000 x 20000 int matrices are
+    // already about 3.2 GB
+    static const int MAX_CITIES = 20000;
+
+    DenseAllPairs() : n(0), stride(0) {}
+
+    // Fills both matrices from the graph's current edges. Memory is two
+    // ints per padded pair, so this is meant for a few thousand cities;
+    // returns false, allocating nothing, above MAX_CITIES.
+    bool build(Graph& g, int threads) {
+        if (g.getNumNodes() > MAX_CITIES) return false;
+        n = g.getNumNodes();
+        stride = (n + TILE - 1) / TILE * TILE;
+        dist.assign((size_t)stride * stride, UNREACHABLE);
+        next.assign((size_t)stride * stride, -1);
+        const uint32_t* off = g.getOffsets();
+        offsets.assign(off, off + n + 1);
+        targets.assign(g.getTargets(), g.getTargets() + off[n]);
+        weights.assign(g.getWeights(), g.getWeights() + off[n]);
+        for (int u = 0; u < n; u++) {
+            size_t rowStart = (size_t)u * stride;
+            dist[rowStart + u] = 0;
+            next[rowStart + u] = u;
+            for (uint32_t e = off[u]; e < off[u + 1]; e++) {
+                VertexId v = targets[e];
+                int w = weights[e] = min(weights[e], (int)UNREACHABLE);
+                if (w < dist[rowStart + v]) {
+                    dist[rowStart + v] = w;
+                    next[rowStart + v] = v;
+                }
+            }
+        }
+        if (n == 0) return true;
+
+        threads = max(1, min(threads, (stride / TILE) * (stride / TILE)));
+        RoundBarrier barrier(threads);
+        vector<thread> team;
+        for (int t = 1; t < threads; t++) {
+            team.push_back(thread(&DenseAllPairs::runRounds, this, t, threads, ref(barrier)));
+        }
+        runRounds(0, threads, barrier);
+        for (int t = 0; t < (int)team.size(); t++) team[t].join();
+        return true;
+    }
+
+    int getNumNodes() const { return n; }
+
+    // Shortest distance from u to v (-1 if there is no path)
+    int distance(VertexId u, VertexId v) const {
+        int d = dist[(size_t)u * stride + v];
+        return d >= UNREACHABLE ? -1 : d;
+    }
+
+    // Algorithm 1 distance u -> capital -> v (-1 if either half is missing)
+    int viaCapitalDistance(VertexId u, VertexId v, VertexId capital) const {
+        int toCapital = distance(u, capital), fromCapital = distance(capital, v);
+        if (toCapital == -1 || fromCapital == -1) return -1;
+        return toCapital + fromCapital;
+    }
+
+    // Next hops from u to v, or -1 if they never reach v (see writePath)
+    int countHops(VertexId u, VertexId v) const {
+        int hops = 0;
+        for (VertexId x = u; x != v; x = next[(size_t)x * stride + v]) {
+            if (++hops == n) return -1;
+        }
+        return hops;
+    }
+
+    // Writes the vertices after u on the way to v, returning how many
+    int writeHops(VertexId u, VertexId v, VertexId* out) const {
+        int hops = 0;
+        for (VertexId x = u; x != v;) {
+            x = next[(size_t)x * stride + v];
+            out[hops++] = x;
+        }
+        return hops;
+    }
+
+    // BFS from u over edges (x, y) with w + dist[y][v] == dist[x][v], which
+    // reaches v along a shortest path with no repeated vertex; appends the
+    // vertices after u
+    void appendTightPath(VertexId u, VertexId v, vector<VertexId>& out) const {
+        vector<int> from(n, -1);
+        vector<VertexId> frontier(1, u);
+        from[u] = u;
+        for (size_t head = 0; head < frontier.size() && from[v] == -1; head++) {
+            VertexId x = frontier[head];
+            int toTarget = dist[(size_t)x * stride + v];
+            for (uint32_t e = offsets[x]; e < offsets[x + 1]; e++) {
+                VertexId y = targets[e];
+                if (from[y] == -1 && weights[e] + dist[(size_t)y * stride + v] == toTarget) {
+                    from[y] = x;
+                    frontier.push_back(y);
+                }
+            }
+        }
+        size_t start = out.size();
+        for (VertexId x = v; x != u; x = from[x]) out.push_back(x);
+        reverse(out.begin() + start, out.end());
+    }
+
+    // Path u -> via -> v (via may be either end), sized by a first walk and
+    // written into the arena by a second. Every next hop is an edge on some
+    // shortest path, but the blocked order can leave them in a cycle
+    // through zero-weight edges. A walk of n hops means that happened, and
+    // the path comes from appendTightPath instead.
+    VertexPath writePath(VertexId u, VertexId via, VertexId v, PathArena<VertexId>& arena) const {
+        int first = countHops(u, via), second = countHops(via, v);
+        if (first == -1 || second == -1) {
+            vector<VertexId> path(1, u);
+            appendTightPath(u, via, path);
+            appendTightPath(via, v, path);
+            return arena.copy(path.data(), path.size());
+        }
+        size_t length = 1 + first + second;
+        VertexId* out = arena.allocate(length);
+        out[0] = u;
+        writeHops(via, v, out + 1 + writeHops(u, via, out + 1));
+        return VertexPath(out, length);
+    }
+
+    PathResult shortestPath(VertexId u, VertexId v, PathArena<VertexId>& arena) const {
+        int d = distance(u, v);
+        if (d == -1) return make_pair(-1, VertexPath());
+        return make_pair(d, writePath(u, u, v, arena));
+    }
+
+    PathResult shortestPathViaCapital(VertexId u, VertexId v, VertexId capital, PathArena<VertexId>& arena) const {
+        int d = viaCapitalDistance(u, v, capital);
+        if (d == -1) return make_pair(-1, VertexPath());
+        return make_pair(d, writePath(u, capital, v, arena));
     }
 };
 
-// Type aliases to make complex types easier to read
-typedef pair<char, char> CityPair;           // (start city, end city)
-typedef pair<int, vector<char> > PathResult;  // (distance, path)
-typedef map<CityPair, PathResult> PathMap;    // stores all paths
+const int DenseAllPairs::TILE;
+const int DenseAllPairs::UNREACHABLE;
+const int DenseAllPairs::MAX_CITIES;
 
-// Graph class using adjacency list
-class Graph {
+// Latency counts in microseconds, kept in a fixed log-scale histogram so
+// a long-running server uses the same memory after a billion requests as
+// after one. Values below 64 get a bucket each; above that every power of
+// two is split into 32 buckets, so a percentile is within about 3%.
+class LatencyStats {
 private:
-    map<char, vector<Edge> > adj;
-    map<char, int> nodeIndex;  // char to index
-    vector<char> indexToNode; // index to char
-    int numNodes;
+    static const int SUB_BUCKETS = 32;
+    static const int NUM_BUCKETS = 59 * SUB_BUCKETS;  // enough for any long long
+
+    vector<long long> buckets;
+    long long total;
+    long long batches;
+
+    static int bucketOf(long long micros) {
+        if (micros < 2 * SUB_BUCKETS) return micros < 0 ? 0 : (int)micros;
+        int shift = 63 - __builtin_clzll((unsigned long long)micros) - 5;
+        return shift * SUB_BUCKETS + (int)(micros >> shift);
+    }
+
+    // Middle of a bucket's value range
+    static long long bucketValue(int bucket) {
+        if (bucket < 2 * SUB_BUCKETS) return bucket;
+        int shift = bucket / SUB_BUCKETS - 1;
+        long long low = (long long)(bucket - shift * SUB_BUCKETS) << shift;
+        return low + ((1LL << shift) - 1) / 2;
+    }
 
 public:
-    Graph() {
-        numNodes = 0;
+    LatencyStats() : buckets(NUM_BUCKETS, 0), total(0), batches(0) {}
+
+    void record(long long micros) {
+        buckets[bucketOf(micros)]++;
+        total++;
     }
-    
-    void addEdge(char u, char v, int weight) {
-        if (nodeIndex.find(u) == nodeIndex.end()) {
-            nodeIndex[u] = numNodes++;
-            indexToNode.push_back(u);
-        }
-        if (nodeIndex.find(v) == nodeIndex.end()) {
-            nodeIndex[v] = numNodes++;
-            indexToNode.push_back(v);
+    void merge(const LatencyStats& other) {
+        for (int i = 0; i < NUM_BUCKETS; i++) buckets[i] += other.buckets[i];
+        total += other.total;
+        batches += other.batches;
+    }
+    void recordBatch() { batches++; }
+    long long count() const { return total; }
+
+    long long percentile(double p) const {
+        if (total == 0) return 0;
+        long long rank = (long long)(p / 100.0 * (total - 1) + 0.5);
+        long long seen = 0;
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+            seen += buckets[i];
+            if (seen > rank) return bucketValue(i);
         }
-        
-        adj[u].push_back(Edge(v, weight));
-        adj[v].push_back(Edge(u, weight));
+        return bucketValue(NUM_BUCKETS - 1);
     }
-    
-    int getNumNodes() const { return numNodes; }
-    
-    map<char, int> getNodeIndex() const { return nodeIndex; }
-    
-    // Dijkstra's algorithm implementation - returns distances and parent pointers
-    pair<vector<int>, vector<int> > dijkstraWithParents(char start) {
-        vector<int> dist(numNodes, INT_MAX);
-        vector<int> parent(numNodes, -1);
-        priority_queue<pair<int, int>, vector<pair<int, int> >, greater<pair<int, int> > > pq;
 
-        int startIdx = nodeIndex[start];
-        dist[startIdx] = 0;
-        pq.push(make_pair(0, startIdx));
+    string summary() const {
+        string s = "queries=" + to_string(count()) + " batches=" + to_string(batches);
+        if (batches > 0) s += " avg_batch=" + to_string(count() / batches);
+        s += " p50=" + to_string(percentile(50)) + "us p99=" + to_string(percentile(99)) + "us";
+        return s;
+    }
+};
 
-        while (!pq.empty()) {
-            int d = pq.top().first;
-            int u = pq.top().second;
-            pq.pop();
+const int LatencyStats::SUB_BUCKETS;
+const int LatencyStats::NUM_BUCKETS;
 
-            if (d > dist[u]) continue;
+// Long-running query service over one loaded graph. Each request is a line
+// "u v [algorithm]" (1 = visits allowed, the default; 2 = no revisits via
+// the labelled tree; 3 = exact disjoint route). The reply is one line,
+// "distance path..." or "-1" when there is no valid path. "stats" replies
+// with the latency counters and "shutdown" stops the server. The capital's
+// tree is built once, so each answer is a tree walk.
+class QueryServer {
+private:
+    Graph& g;
+    VertexId capital;
+    DisjointPathRouter router;
+    LatencyStats stats;
+    bool stopping;
+    string from, to;   // scratch names, reused across requests
+    PathArena<VertexId> paths;  // holds one reply's path, cleared per request
 
-            char uNode = indexToNode[u];
-            for (int i = 0; i < (int)adj[uNode].size(); i++) {
-                Edge edge = adj[uNode][i];
-                int v = nodeIndex[edge.to];
-                int newDist = dist[u] + edge.weight;
+public:
+    static const size_t MAX_LINE_BYTES = 4096;  // longest request line answered
 
-                if (newDist < dist[v]) {
-                    dist[v] = newDist;
-                    parent[v] = u;
-                    pq.push(make_pair(newDist, v));
-                }
+    QueryServer(Graph& graph, VertexId capital) : g(graph), router(graph, capital) {
+        this->capital = capital;
+        stopping = false;
+        g.getLabeledTree(capital);
+    }
+
+    bool isStopping() const { return stopping; }
+    const LatencyStats& getStats() const { return stats; }
+
+    // Answer one request line, appending the reply (with newline) to out
+    void answer(const char* line, size_t length, string& out) {
+        if (length > MAX_LINE_BYTES) {
+            out += "error: request line too long\n";
+            return;
+        }
+        TokenView tokens[3];
+        int count = 0;
+        size_t i = 0;
+        while (i < length && count < 3) {
+            while (i < length && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r')) i++;
+            if (i >= length) break;
+            tokens[count].data = line + i;
+            while (i < length && line[i] != ' ' && line[i] != '\t' && line[i] != '\r') i++;
+            tokens[count].length = (uint32_t)(line + i - tokens[count].data);
+            count++;
+        }
+        if (count == 1 && tokens[0].str() == "stats") {
+            out += stats.summary() + "\n";
+            return;
+        }
+        if (count == 1 && tokens[0].str() == "shutdown") {
+            stopping = true;
+            out += "bye\n";
+            return;
+        }
+        int algorithm = 1;
+        if (count == 3) {
+            algorithm = tokens[2].length == 1 ? tokens[2].data[0] - '0' : 0;
+        }
+        if (count < 2 || algorithm < 1 || algorithm > 3) {
+            out += "error: expected \"u v [1|2|3]\"\n";
+            return;
+        }
+        from.assign(tokens[0].data, tokens[0].length);
+        to.assign(tokens[1].data, tokens[1].length);
+        VertexId u = g.findVertex(from);
+        VertexId v = g.findVertex(to);
+
+        paths.clear();
+        PathResult result(-1, VertexPath());
+        if (u != VertexDictionary::NOT_FOUND && v != VertexDictionary::NOT_FOUND) {
+            if (algorithm == 2) {
+                if (u != v && u != capital && v != capital) result = g.shortestPathViaCapitalAlg2(u, v, capital, paths);
+            } else if (algorithm == 3) {
+                result = router.route(u, v, paths);
+            } else {
+                result = g.shortestPathViaCapital(u, v, capital, paths);
             }
         }
+        out += to_string(result.first);
+        for (int p = 0; p < (int)result.second.size(); p++) {
+            TokenView name = g.getDictionary().name(result.second[p]);
+            out += p == 0 ? ' ' : ',';
+            out.append(name.data, name.length);
+        }
+        out += '\n';
+    }
 
-        return make_pair(dist, parent);
+    // Answer a batch of complete lines; the latency of each request runs
+    // from when it arrived to when its reply is ready
+    void answerBatch(const vector<pair<const char*, size_t> >& lines,
+                     const vector<high_resolution_clock::time_point>& arrivals, vector<string*>& replies) {
+        for (int i = 0; i < (int)lines.size(); i++) {
+            answer(lines[i].first, lines[i].second, *replies[i]);
+            stats.record(duration_cast<microseconds>(high_resolution_clock::now() - arrivals[i]).count());
+        }
+        stats.recordBatch();
     }
 
-    // Extract path from parent array
-    vector<char> extractPath(int from, int to, const vector<int>& parent) {
-        vector<char> path;
-        int curr = to;
+    // Requests on stdin, replies on stdout, until EOF or "shutdown"
+    void serveStdin() {
+        string line, reply;
+        while (!stopping && getline(cin, line)) {
+            auto arrival = high_resolution_clock::now();
+            reply.clear();
+            answer(line.data(), line.size(), reply);
+            stats.record(duration_cast<microseconds>(high_resolution_clock::now() - arrival).count());
+            stats.recordBatch();
+            cout << reply << flush;
+        }
+    }
 
-        while (curr != from) {
-            path.push_back(indexToNode[curr]);
-            curr = parent[curr];
+    // Requests from any number of clients on a Unix domain socket. Every
+    // poll() wake-up collects the complete lines from all readable clients
+    // into one batch and answers it. Client sockets are non-blocking: each
+    // client keeps its unsent replies and is polled for POLLOUT until they
+    // are gone, so a client that reads slowly only delays itself. A client
+    // with more than MAX_BACKLOG_BYTES unsent is not read from until it
+    // catches up. A partial line is never buffered past MAX_LINE_BYTES: the
+    // client gets the error reply and the rest of the line is dropped.
+    bool serveSocket(const string& path) {
+        const size_t MAX_BACKLOG_BYTES = 1 << 20;
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (listener < 0) return false;
+        if (path.size() >= sizeof(address.sun_path)) {
+            close(listener);
+            return false;
         }
-        path.push_back(indexToNode[from]);
+        strcpy(address.sun_path, path.c_str());
+        // Replace a stale socket from an earlier run, but never any other file
+        struct stat existing;
+        if (lstat(path.c_str(), &existing) == 0) {
+            if (!S_ISSOCK(existing.st_mode)) {
+                close(listener);
+                return false;
+            }
+            unlink(path.c_str());
+        }
+        if (bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+            close(listener);
+            return false;
+        }
+
+        vector<pollfd> fds(1);
+        fds[0].fd = listener;
+        fds[0].events = POLLIN;
+        vector<string> pending(1), replies(1);   // per client: partial input, unsent replies
+        vector<char> skipping(1, 0);             // per client: dropping an over-long line
+        char buffer[65536];
+
+        while (!stopping) {
+            for (int c = 1; c < (int)fds.size(); c++) {
+                fds[c].events = replies[c].size() > MAX_BACKLOG_BYTES ? 0 : POLLIN;
+                if (!replies[c].empty()) fds[c].events |= POLLOUT;
+            }
+            if (poll(fds.data(), fds.size(), -1) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (fds[0].revents & POLLIN) {
+                int client = accept(listener, NULL, NULL);
+                if (client >= 0 && fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK) == 0) {
+                    pollfd entry;
+                    entry.fd = client;
+                    entry.events = POLLIN;
+                    entry.revents = 0;
+                    fds.push_back(entry);
+                    pending.push_back(string());
+                    replies.push_back(string());
+                    skipping.push_back(0);
+                } else if (client >= 0) {
+                    close(client);
+                }
+            }
+
+            auto arrival = high_resolution_clock::now();
+            vector<pair<const char*, size_t> > lines;
+            vector<high_resolution_clock::time_point> arrivals;
+            vector<string*> targets;
+            vector<size_t> consumed(fds.size(), 0);
+            vector<char> tooLong(fds.size(), 0);
+            for (int c = 1; c < (int)fds.size(); c++) {
+                if (fds[c].fd < 0 || !(fds[c].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+                ssize_t got = read(fds[c].fd, buffer, sizeof(buffer));
+                if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+                if (got <= 0) {
+                    close(fds[c].fd);
+                    fds[c].fd = -1;
+                    continue;
+                }
+                pending[c].append(buffer, got);
+                if (skipping[c]) {
+                    size_t newline = pending[c].find('\n');
+                    if (newline == string::npos) {
+                        pending[c].clear();
+                        continue;
+                    }
+                    pending[c].erase(0, newline + 1);
+                    skipping[c] = 0;
+                }
+                size_t start = 0, newline;
+                while ((newline = pending[c].find('\n', start)) != string::npos) {
+                    lines.push_back(make_pair(pending[c].data() + start, newline - start));
+                    arrivals.push_back(arrival);
+                    targets.push_back(&replies[c]);
+                    start = newline + 1;
+                }
+                consumed[c] = start;
+                if (pending[c].size() - start > MAX_LINE_BYTES) {
+                    // No newline yet and already too long: drop it as it arrives
+                    consumed[c] = pending[c].size();
+                    skipping[c] = 1;
+                    tooLong[c] = 1;
+                }
+            }
+            if (!lines.empty()) answerBatch(lines, arrivals, targets);
 
-        // Reverse to get path from 'from' to 'to'
-        for (int i = 0; i < (int)path.size() / 2; i++) {
-            char temp = path[i];
-            path[i] = path[path.size() - 1 - i];
-            path[path.size() - 1 - i] = temp;
+            for (int c = 1; c < (int)fds.size(); c++) {
+                pending[c].erase(0, consumed[c]);
+                if (tooLong[c]) replies[c] += "error: request line too long\n";
+                if (fds[c].fd < 0 || replies[c].empty()) continue;
+                ssize_t n = send(fds[c].fd, replies[c].data(), replies[c].size(), MSG_NOSIGNAL);
+                if (n > 0) {
+                    replies[c].erase(0, n);
+                } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    close(fds[c].fd);
+                    fds[c].fd = -1;
+                }
+            }
+
+            // Drop closed clients
+            int kept = 1;
+            for (int c = 1; c < (int)fds.size(); c++) {
+                if (fds[c].fd < 0) continue;
+                fds[kept] = fds[c];
+                pending[kept].swap(pending[c]);
+                replies[kept].swap(replies[c]);
+                skipping[kept] = skipping[c];
+                kept++;
+            }
+            fds.resize(kept);
+            pending.resize(kept);
+            replies.resize(kept);
+            skipping.resize(kept);
         }
 
-        return path;
+        for (int c = 0; c < (int)fds.size(); c++) close(fds[c].fd);
+        unlink(path.c_str());
+        return true;
     }
+};
 
-    // Check if two paths share any vertices (except the capital)
-    bool pathsShareVertices(const vector<char>& path1, const vector<char>& path2, char capital) {
-        map<char, bool> visited;
+const size_t QueryServer::MAX_LINE_BYTES;
 
-        // Mark all vertices in path1 (except capital)
-        for (int i = 0; i < (int)path1.size(); i++) {
-            if (path1[i] != capital) {
-                visited[path1[i]] = true;
+// Load-test stand-in: each client thread connects to the server, keeps up
+// to `window` requests in flight and measures round-trip latency
+void runLoadTest(const string& path, const vector<string>& names, int clients, int requestsPerClient) {
+    const int window = 32;
+    vector<LatencyStats> perClient(clients);
+    auto start = high_resolution_clock::now();
+    vector<thread> pool;
+    for (int c = 0; c < clients; c++) {
+        pool.push_back(thread([&, c]() {
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un address;
+            memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+            if (fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+                if (fd >= 0) close(fd);
+                return;
             }
-        }
+            mt19937 rng(1800 + c);
+            uniform_int_distribution<int> pick(0, (int)names.size() - 1);
+            deque<high_resolution_clock::time_point> inFlight;
+            string incoming;
+            char buffer[65536];
+            int sentCount = 0, answered = 0;
+            while (answered < requestsPerClient) {
+                string batch;
+                while (sentCount < requestsPerClient && (int)inFlight.size() < window) {
+                    batch += names[pick(rng)] + " " + names[pick(rng)] + " " + to_string(1 + sentCount % 3) + "\n";
+                    inFlight.push_back(high_resolution_clock::now());
+                    sentCount++;
+                }
+                if (!batch.empty() && send(fd, batch.data(), batch.size(), MSG_NOSIGNAL) != (ssize_t)batch.size()) break;
+                ssize_t got = read(fd, buffer, sizeof(buffer));
+                if (got <= 0) break;
+                incoming.append(buffer, got);
+                size_t start = 0, newline;
+                while ((newline = incoming.find('\n', start)) != string::npos) {
+                    perClient[c].record(duration_cast<microseconds>(high_resolution_clock::now() - inFlight.front()).count());
+                    inFlight.pop_front();
+                    answered++;
+                    start = newline + 1;
+                }
+                incoming.erase(0, start);
+            }
+            close(fd);
+        }));
+    }
+    for (int c = 0; c < clients; c++) pool[c].join();
+    long long elapsed = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
 
-        // Check if any vertex in path2 (except capital) is in path1
-        for (int i = 0; i < (int)path2.size(); i++) {
-            if (path2[i] != capital && visited[path2[i]]) {
-                return true;
+    LatencyStats all;
+    for (int c = 0; c < clients; c++) all.merge(perClient[c]);
+    cout << "Load test: " << clients << " clients x " << requestsPerClient << " requests, " << all.count()
+         << " answered in " << elapsed << " us (" << (elapsed > 0 ? all.count() * 1000000 / elapsed : 0)
+         << " queries/s), round trip p50=" << all.percentile(50) << "us p99=" << all.percentile(99) << "us" << endl;
+}
+
+// Time one Dijkstra run with the given queue (in microseconds)
+long long timeDijkstra(Graph& g, QueueKind kind, vector<int>& dist) {
+    g.setQueueKind(kind);
+    auto start = high_resolution_clock::now();
+    dist = g.dijkstraWithParents(0).first;
+    auto end = high_resolution_clock::now();
+    return duration_cast<microseconds>(end - start).count();
+}
+
+// Compare the three Dijkstra queues on random connected graphs of growing
+// size and maximum edge weight, to show where each one wins
+void runQueueBenchmark() {
+    int sizes[] = {1000, 10000, 100000, 1000000};
+    int maxWeights[] = {1, 10, 100, 10000, 1000000};
+    const char* kindNames[] = {"binary", "radix", "dial"};
+    mt19937 rng(375);
+
+    cout << "=== DIJKSTRA PRIORITY QUEUE BENCHMARK ===" << endl;
+    cout << "Vertices\tEdges\tMaxWeight\tBinary(us)\tRadix(us)\tDial(us)\tFastest" << endl;
+
+    for (int s = 0; s < 4; s++) {
+        int n = sizes[s];
+        int m = 4 * n;
+        vector<string> names(n);
+        for (int i = 0; i < n; i++) names[i] = "v" + to_string(i);
+
+        for (int w = 0; w < 5; w++) {
+            uniform_int_distribution<int> pickVertex(0, n - 1);
+            uniform_int_distribution<int> pickWeight(1, maxWeights[w]);
+
+            // Random spanning tree keeps the graph connected, the rest are random edges
+            Graph g;
+            for (int i = 1; i < n; i++) {
+                uniform_int_distribution<int> pickEarlier(0, i - 1);
+                g.addEdge(names[pickEarlier(rng)], names[i], pickWeight(rng));
+            }
+            for (int i = n - 1; i < m; i++) {
+                g.addEdge(names[pickVertex(rng)], names[pickVertex(rng)], pickWeight(rng));
+            }
+            g.dijkstraWithParents(0);  // build the CSR arrays outside the timed runs
+
+            vector<int> reference, dist;
+            long long times[3];
+            times[0] = timeDijkstra(g, BINARY_HEAP, reference);
+            times[1] = timeDijkstra(g, RADIX_HEAP, dist);
+            bool same = (dist == reference);
+            times[2] = timeDijkstra(g, DIAL_BUCKETS, dist);
+            same = same && (dist == reference);
+
+            int best = 0;
+            for (int k = 1; k < 3; k++) {
+                if (times[k] < times[best]) best = k;
             }
+            cout << n << "\t" << m << "\t" << maxWeights[w] << "\t"
+                 << times[0] << "\t" << times[1] << "\t" << times[2] << "\t"
+                 << kindNames[best] << (same ? "" : "\t(DISTANCES DIFFER!)") << endl;
         }
+    }
+}
 
-        return false;
+// Multi-capital batches: one thread vs the work-stealing pool on a random
+// graph, checking both give the same answers
+void runBatchBenchmark() {
+    const int n = 200000, m = 4 * n, numCapitals = 64, numQueries = 400000;
+    mt19937 rng(1900);
+    uniform_int_distribution<int> pickVertex(0, n - 1);
+    uniform_int_distribution<int> pickWeight(1, 1000);
+    Graph g;
+    vector<string> names(n);
+    for (int i = 0; i < n; i++) names[i] = "v" + to_string(i);
+    for (int i = 1; i < n; i++) {
+        uniform_int_distribution<int> pickEarlier(0, i - 1);
+        g.addEdge(names[pickEarlier(rng)], names[i], pickWeight(rng));
     }
-    
-    PathResult shortestPathViaCapital(char start, char end, char capital) {
-        pair<vector<int>, vector<int> > result = dijkstraWithParents(capital);
-        vector<int> distFromCapital = result.first;
-        vector<int> parent = result.second;
+    for (int i = n - 1; i < m; i++) {
+        g.addEdge(names[pickVertex(rng)], names[pickVertex(rng)], pickWeight(rng));
+    }
+    g.getOffsets();  // build the CSR arrays outside the timed runs
 
-        int capitalIdx = nodeIndex.find(capital)->second;
-        int startIdx = nodeIndex.find(start)->second;
-        int endIdx = nodeIndex.find(end)->second;
+    vector<RouteQuery> queries(numQueries);
+    for (int i = 0; i < numQueries; i++) {
+        queries[i].capital = (VertexId)(pickVertex(rng) % numCapitals * (n / numCapitals));
+        queries[i].from = pickVertex(rng);
+        queries[i].to = pickVertex(rng);
+    }
 
-        if (distFromCapital[startIdx] == INT_MAX || distFromCapital[endIdx] == INT_MAX) {
-            vector<char> emptyPath;
-            return make_pair(-1, emptyPath);
+    cout << "=== BATCH QUERY BENCHMARK (" << n << " vertices, " << m << " edges, " << numCapitals
+         << " capitals, " << numQueries << " queries) ===" << endl;
+    cout << "Threads\tTime(us)\tQueries/s\tSame answers" << endl;
+    vector<PathResult> reference;
+    PathArena<VertexId> referencePaths, paths;
+    int maxThreads = max(1, (int)thread::hardware_concurrency());
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        g.clearTreeCache();  // every run pays for its own Dijkstras
+        paths.clear();
+        auto start = high_resolution_clock::now();
+        vector<PathResult> results = g.batchShortestPaths(queries, threads, reference.empty() ? referencePaths : paths);
+        long long us = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+        if (reference.empty()) reference = results;
+        cout << threads << "\t" << us << "\t" << (us > 0 ? (long long)numQueries * 1000000 / us : 0) << "\t"
+             << (results == reference ? "yes" : "NO") << endl;
+    }
+    cout << endl;
+}
+
+// Delta-stepping vs binary-heap Dijkstra on a road-like grid (each
+// vertex linked to its right and lower neighbours, weights 1-1000), for
+// several bucket widths and thread counts
+void runDeltaBenchmark() {
+    const int side = 1000, n = side * side;
+    mt19937 rng(2000);
+    uniform_int_distribution<int> pickWeight(1, 1000);
+    Graph g;
+    vector<string> names(n);
+    for (int i = 0; i < n; i++) names[i] = "v" + to_string(i);
+    for (int r = 0; r < side; r++) {
+        for (int c = 0; c < side; c++) {
+            if (c + 1 < side) g.addEdge(names[r * side + c], names[r * side + c + 1], pickWeight(rng));
+            if (r + 1 < side) g.addEdge(names[r * side + c], names[(r + 1) * side + c], pickWeight(rng));
         }
+    }
+    g.getOffsets();  // build the CSR arrays outside the timed runs
 
-        int totalDist = distFromCapital[startIdx] + distFromCapital[endIdx];
+    cout << "=== DELTA-STEPPING BENCHMARK (" << side << "x" << side << " grid, "
+         << g.getOffsets()[n] / 2 << " edges, weights 1-1000) ===" << endl;
+    g.setQueueKind(BINARY_HEAP);
+    auto start = high_resolution_clock::now();
+    vector<int> reference = g.dijkstraWithParents(0).first;
+    long long dijkstraTime = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+    cout << "Binary-heap Dijkstra: " << dijkstraTime << " us" << endl;
 
-        // Build actual path: start -> ... -> capital -> ... -> end
-        vector<char> pathToStart = extractPath(capitalIdx, startIdx, parent);
-        vector<char> pathToEnd = extractPath(capitalIdx, endIdx, parent);
+    cout << "Delta\tThreads\tTime(us)\tSame distances\tSame parents as 1 thread" << endl;
+    g.setQueueKind(DELTA_STEPPING);
+    int widths[] = {0, 100, 1000, 5000};
+    int maxThreads = max(1, (int)thread::hardware_concurrency());
+    for (int w = 0; w < 4; w++) {
+        g.setDeltaWidth(widths[w]);
+        vector<int> firstParents;
+        for (int threads = 1; threads <= maxThreads; threads *= 2) {
+            g.setNumThreads(threads);
+            start = high_resolution_clock::now();
+            pair<vector<int>, vector<int> > result = g.dijkstraWithParents(0);
+            long long us = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+            if (firstParents.empty()) firstParents = result.second;
+            cout << (widths[w] == 0 ? string("auto") : to_string(widths[w])) << "\t" << threads << "\t" << us << "\t"
+                 << (result.first == reference ? "yes" : "NO") << "\t"
+                 << (result.second == firstParents ? "yes" : "NO") << endl;
+        }
+    }
+    cout << endl;
+}
 
-        vector<char> fullPath;
-        // Reverse path from capital to start (to get start to capital)
-        for (int i = (int)pathToStart.size() - 1; i >= 0; i--) {
-            fullPath.push_back(pathToStart[i]);
+// Contraction hierarchy on a road-like grid: preprocessing time, shortcut
+// count and query latency against plain Dijkstra, checking every distance
+// and that each unpacked path is a real path of that length
+void runContractionBenchmark() {
+    const int side = 200, n = side * side, numQueries = 500;
+    mt19937 rng(2100);
+    uniform_int_distribution<int> pickWeight(1, 1000);
+    uniform_int_distribution<int> pickVertex(0, n - 1);
+    Graph g;
+    vector<string> names(n);
+    for (int i = 0; i < n; i++) names[i] = "v" + to_string(i);
+    for (int r = 0; r < side; r++) {
+        for (int c = 0; c < side; c++) {
+            if (c + 1 < side) g.addEdge(names[r * side + c], names[r * side + c + 1], pickWeight(rng));
+            if (r + 1 < side) g.addEdge(names[r * side + c], names[(r + 1) * side + c], pickWeight(rng));
         }
-        // Add path from capital to end (skip capital since already added)
-        for (int i = 1; i < (int)pathToEnd.size(); i++) {
-            fullPath.push_back(pathToEnd[i]);
+    }
+    g.getOffsets();
+
+    cout << "=== CONTRACTION HIERARCHY BENCHMARK (" << side << "x" << side << " grid, "
+         << g.getOffsets()[n] / 2 << " edges, " << numQueries << " random queries) ===" << endl;
+    ContractionHierarchy ch;
+    auto start = high_resolution_clock::now();
+    ch.build(g);
+    long long buildTime = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+    cout << "Preprocessing: " << buildTime << " us, " << ch.getNumShortcuts() << " shortcuts, "
+         << ch.getNumUpEdges() << " upward edges" << endl;
+
+    // Each (u, v) weight, for checking unpacked paths
+    map<pair<VertexId, VertexId>, int> edgeWeight;
+    const uint32_t* off = g.getOffsets();
+    for (int u = 0; u < n; u++) {
+        for (uint32_t e = off[u]; e < off[u + 1]; e++) edgeWeight[make_pair((VertexId)u, g.getTargets()[e])] = g.getWeights()[e];
+    }
+
+    LatencyStats chLatency, dijkstraLatency;
+    PathArena<VertexId> paths;
+    int wrong = 0;
+    for (int i = 0; i < numQueries; i++) {
+        VertexId s = pickVertex(rng), t = pickVertex(rng);
+        paths.clear();
+        start = high_resolution_clock::now();
+        PathResult answer = ch.query(s, t, paths);
+        chLatency.record(duration_cast<microseconds>(high_resolution_clock::now() - start).count());
+        start = high_resolution_clock::now();
+        int expected = g.dijkstraWithParents(s).first[t];
+        dijkstraLatency.record(duration_cast<microseconds>(high_resolution_clock::now() - start).count());
+
+        long long length = 0;
+        bool valid = !answer.second.empty() && answer.second.front() == s && answer.second.back() == t;
+        for (int k = 0; valid && k + 1 < (int)answer.second.size(); k++) {
+            map<pair<VertexId, VertexId>, int>::const_iterator it =
+                edgeWeight.find(make_pair(answer.second[k], answer.second[k + 1]));
+            if (it == edgeWeight.end()) valid = false;
+            else length += it->second;
         }
+        if (answer.first != expected || !valid || length != expected) wrong++;
+    }
+    cout << "CH query:       " << chLatency.summary() << endl;
+    cout << "Dijkstra query: " << dijkstraLatency.summary() << endl;
+    cout << "Wrong answers: " << wrong << endl;
 
-        return make_pair(totalDist, fullPath);
+    string indexFile = "/tmp/b2_ch_bench.idx";
+    ContractionHierarchy reloaded;
+    string error;
+    bool roundTrip = ch.save(indexFile) && reloaded.load(indexFile, g, error);
+    for (int i = 0; roundTrip && i < 100; i++) {
+        VertexId s = pickVertex(rng), t = pickVertex(rng);
+        roundTrip = reloaded.query(s, t, paths) == ch.query(s, t, paths);
     }
-    
-    PathMap allPairsViaCapitalAlg2(char capital) {
-        PathMap result;
-        pair<vector<int>, vector<int> > dijkstraResult = dijkstraWithParents(capital);
-        vector<int> distFromCapital = dijkstraResult.first;
-        vector<int> parent = dijkstraResult.second;
-
-        int capitalIdx = nodeIndex.find(capital)->second;
-
-        for (map<char, int>::iterator it1 = nodeIndex.begin(); it1 != nodeIndex.end(); ++it1) {
-            for (map<char, int>::iterator it2 = nodeIndex.begin(); it2 != nodeIndex.end(); ++it2) {
-                char u = it1->first;
-                char v = it2->first;
-
-                if (u != capital && v != capital && u != v) {
-                    int uIdx = it1->second;
-                    int vIdx = it2->second;
-
-                    if (distFromCapital[uIdx] == INT_MAX || distFromCapital[vIdx] == INT_MAX) {
-                        vector<char> emptyPath;
-                        result[make_pair(u, v)] = make_pair(-1, emptyPath);
-                    } else {
-                        // Extract actual paths from capital
-                        vector<char> pathToU = extractPath(capitalIdx, uIdx, parent);
-                        vector<char> pathToV = extractPath(capitalIdx, vIdx, parent);
-
-                        // Check if paths share any vertices (except capital)
-                        if (pathsShareVertices(pathToU, pathToV, capital)) {
-                            // Paths overlap - violates no-revisit constraint
-                            vector<char> emptyPath;
-                            result[make_pair(u, v)] = make_pair(-1, emptyPath);
-                        } else {
-                            // Paths are disjoint - valid path exists
-                            int totalDist = distFromCapital[uIdx] + distFromCapital[vIdx];
-
-                            // Build full path: u -> ... -> capital -> ... -> v
-                            vector<char> fullPath;
-                            for (int i = (int)pathToU.size() - 1; i >= 0; i--) {
-                                fullPath.push_back(pathToU[i]);
-                            }
-                            for (int i = 1; i < (int)pathToV.size(); i++) {
-                                fullPath.push_back(pathToV[i]);
-                            }
+    remove(indexFile.c_str());
+    cout << "Saved index answers the same: " << (roundTrip ? "yes" : "NO") << endl;
+    cout << endl;
+}
 
-                            result[make_pair(u, v)] = make_pair(totalDist, fullPath);
-                        }
-                    }
-                }
-            }
+// Road updates on a grid: latency of updateEdgeWeight / removeEdge with
+// the capital's tree repaired in place, against rerunning Dijkstra, which
+// also checks every repaired tree has the same distances
+void runUpdateBenchmark() {
+    const int side = 300, n = side * side, numUpdates = 300;
+    mt19937 rng(2200);
+    uniform_int_distribution<int> pickWeight(1, 1000);
+    uniform_int_distribution<int> pickCell(0, side - 2);
+    Graph g;
+    vector<string> names(n);
+    for (int i = 0; i < n; i++) names[i] = "v" + to_string(i);
+    vector<int> weight(2 * n, 0);  // current weight of the right (2i) and lower (2i+1) road of cell i
+    for (int r = 0; r < side; r++) {
+        for (int c = 0; c < side; c++) {
+            int i = r * side + c;
+            if (c + 1 < side) g.addEdge(names[i], names[i + 1], weight[2 * i] = pickWeight(rng));
+            if (r + 1 < side) g.addEdge(names[i], names[i + side], weight[2 * i + 1] = pickWeight(rng));
         }
+    }
+    VertexId capital = g.findVertex(names[side / 2 * side + side / 2]);
+    g.getTree(capital);
 
-        return result;
+    cout << "=== EDGE UPDATE BENCHMARK (" << side << "x" << side << " grid, " << numUpdates
+         << " updates, capital in the centre) ===" << endl;
+    const char* kinds[3] = {"Increase", "Decrease", "Remove"};
+    LatencyStats latency[3], recompute;
+    int mismatches = 0;
+    for (int k = 0; k < numUpdates; k++) {
+        int kind = k % 3;
+        int i, road;
+        do {
+            i = pickCell(rng) * side + pickCell(rng);
+            road = 2 * i + (int)(rng() % 2);
+        } while (weight[road] == 0);  // skip roads already removed
+        const string& other = names[road % 2 == 0 ? i + 1 : i + side];
+
+        auto start = high_resolution_clock::now();
+        if (kind == 0) {
+            g.updateEdgeWeight(names[i], other, weight[road] *= 3);
+        } else if (kind == 1) {
+            g.updateEdgeWeight(names[i], other, weight[road] = max(1, weight[road] / 3));
+        } else {
+            g.removeEdge(names[i], other);
+            weight[road] = 0;
+        }
+        latency[kind].record(duration_cast<microseconds>(high_resolution_clock::now() - start).count());
+
+        start = high_resolution_clock::now();
+        pair<vector<int>, vector<int> > full = g.dijkstraWithParents(capital);
+        recompute.record(duration_cast<microseconds>(high_resolution_clock::now() - start).count());
+        const ShortestPathTree& tree = g.getTree(capital);
+        if (full.first != tree.dist || full.second != tree.parent) mismatches++;
     }
-    
-    void printPath(const vector<char>& path) {
-        for (int i = 0; i < (int)path.size(); i++) {
-            cout << path[i];
-            if (i < (int)path.size() - 1) cout << ", ";
+    for (int kind = 0; kind < 3; kind++) {
+        cout << kinds[kind] << ":\tp50=" << latency[kind].percentile(50) << "us p99=" << latency[kind].percentile(99)
+             << "us" << endl;
+    }
+    cout << "Full Dijkstra:\tp50=" << recompute.percentile(50) << "us p99=" << recompute.percentile(99) << "us" << endl;
+    cout << "Repaired trees differing from a recompute: " << mismatches << endl;
+    cout << endl;
+}
+
+// Dense random graph: the blocked Floyd-Warshall engine against running
+// dijkstraWithParents from every city, checking every distance and that
+// sampled paths from the next-hop matrix are real paths of that length
+void runDenseBenchmark() {
+    const int n = 512, numSamples = 2000;
+    mt19937 rng(2300);
+    uniform_int_distribution<int> pickWeight(1, 1000);
+    uniform_int_distribution<int> pickVertex(0, n - 1);
+    bernoulli_distribution keepEdge(0.3);
+    Graph g;
+    vector<string> names(n);
+    for (int i = 0; i < n; i++) names[i] = "v" + to_string(i);
+    for (int u = 0; u < n; u++) {
+        for (int v = u + 1; v < n; v++) {
+            if (keepEdge(rng)) g.addEdge(names[u], names[v], pickWeight(rng));
         }
     }
-    
-    void printGraph() {
-        cout << "Graph with " << numNodes << " nodes:" << endl;
-        for (map<char, vector<Edge> >::iterator it = adj.begin(); it != adj.end(); ++it) {
-            cout << "Node " << it->first << " -> ";
-            for (int i = 0; i < (int)it->second.size(); i++) {
-                cout << it->second[i].to << "(" << it->second[i].weight << ")";
-                if (i < (int)it->second.size() - 1) cout << ", ";
+    g.getOffsets();
+
+    cout << "=== DENSE ALL-PAIRS BENCHMARK (" << n << " cities, " << g.getOffsets()[n] / 2
+         << " edges, weights 1-1000) ===" << endl;
+    auto start = high_resolution_clock::now();
+    vector<vector<int> > reference(n);
+    for (int s = 0; s < n; s++) reference[s] = g.dijkstraWithParents(s).first;
+    long long dijkstraTime = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+    cout << "Dijkstra from every city: " << dijkstraTime << " us" << endl;
+
+    cout << "Floyd-Warshall kernel: " << minPlusKernelName() << endl;
+    cout << "Threads\tTime(us)\tSame distances" << endl;
+    DenseAllPairs dense;
+    int maxThreads = max(1, (int)thread::hardware_concurrency());
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        start = high_resolution_clock::now();
+        dense.build(g, threads);
+        long long us = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+        bool same = true;
+        for (int u = 0; same && u < n; u++) {
+            for (int v = 0; same && v < n; v++) {
+                int expected = reference[u][v] == INT_MAX ? -1 : reference[u][v];
+                same = dense.distance(u, v) == expected;
             }
-            cout << endl;
+        }
+        cout << threads << "\t" << us << "\t" << (same ? "yes" : "NO") << endl;
+    }
+
+    map<pair<VertexId, VertexId>, int> edgeWeight;
+    const uint32_t* off = g.getOffsets();
+    for (int u = 0; u < n; u++) {
+        for (uint32_t e = off[u]; e < off[u + 1]; e++) {
+            pair<VertexId, VertexId> key((VertexId)u, g.getTargets()[e]);
+            map<pair<VertexId, VertexId>, int>::iterator it = edgeWeight.find(key);
+            if (it == edgeWeight.end() || g.getWeights()[e] < it->second) edgeWeight[key] = g.getWeights()[e];
+        }
+    }
+    PathArena<VertexId> paths;
+    int wrong = 0;
+    for (int i = 0; i < numSamples; i++) {
+        VertexId u = pickVertex(rng), v = pickVertex(rng);
+        PathResult answer = i % 2 == 0 ? dense.shortestPath(u, v, paths) : dense.shortestPathViaCapital(u, v, 0, paths);
+        long long length = 0;
+        bool valid = !answer.second.empty() && answer.second.front() == u && answer.second.back() == v;
+        for (int k = 0; valid && k + 1 < (int)answer.second.size(); k++) {
+            map<pair<VertexId, VertexId>, int>::const_iterator it =
+                edgeWeight.find(make_pair(answer.second[k], answer.second[k + 1]));
+            if (it == edgeWeight.end()) valid = false;
+            else length += it->second;
+        }
+        if (!valid || length != answer.first) wrong++;
+    }
+    cout << "Sampled paths not matching their distance: " << wrong << endl;
+    cout << endl;
+}
+
+int main(int argc, char* argv[]) {
+    QueueKind queueKind = BINARY_HEAP;
+    string allPairsFile;
+    string snapshotFile, writeSnapshotFile;
+    bool verifySnapshot = false;
+    string queriesFile = "B2_input.txt";
+    bool serveStdin = false;
+    string serveSocket, loadTestSocket;
+    string batchFile;
+    string chBuildFile, chFile, routeFile;
+    string denseFile;
+    int threads = thread::hardware_concurrency();
+    int deltaWidth = 0;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.compare(0, 12, "--all-pairs=") == 0) {
+            allPairsFile = arg.substr(12);
+        } else if (arg.compare(0, 11, "--snapshot=") == 0) {
+            snapshotFile = arg.substr(11);
+        } else if (arg == "--verify-snapshot") {
+            verifySnapshot = true;
+        } else if (arg.compare(0, 17, "--write-snapshot=") == 0) {
+            writeSnapshotFile = arg.substr(17);
+        } else if (arg.compare(0, 10, "--queries=") == 0) {
+            queriesFile = arg.substr(10);
+        } else if (arg == "--serve") {
+            serveStdin = true;
+        } else if (arg.compare(0, 8, "--serve=") == 0) {
+            serveSocket = arg.substr(8);
+        } else if (arg.compare(0, 12, "--load-test=") == 0) {
+            loadTestSocket = arg.substr(12);
+        } else if (arg.compare(0, 8, "--batch=") == 0) {
+            batchFile = arg.substr(8);
+        } else if (arg.compare(0, 10, "--threads=") == 0) {
+            threads = atoi(arg.c_str() + 10);
+        } else if (arg == "--bench-batch") {
+            runBatchBenchmark();
+            return 0;
+        } else if (arg == "--bench-pq") {
+            runQueueBenchmark();
+            return 0;
+        } else if (arg == "--pq=binary") {
+            queueKind = BINARY_HEAP;
+        } else if (arg == "--pq=radix") {
+            queueKind = RADIX_HEAP;
+        } else if (arg == "--pq=dial") {
+            queueKind = DIAL_BUCKETS;
+        } else if (arg == "--pq=delta") {
+            queueKind = DELTA_STEPPING;
+        } else if (arg.compare(0, 8, "--delta=") == 0) {
+            deltaWidth = atoi(arg.c_str() + 8);
+        } else if (arg == "--bench-delta") {
+            runDeltaBenchmark();
+            return 0;
+        } else if (arg.compare(0, 11, "--ch-build=") == 0) {
+            chBuildFile = arg.substr(11);
+        } else if (arg.compare(0, 5, "--ch=") == 0) {
+            chFile = arg.substr(5);
+        } else if (arg.compare(0, 8, "--route=") == 0) {
+            routeFile = arg.substr(8);
+        } else if (arg == "--bench-ch") {
+            runContractionBenchmark();
+            return 0;
+        } else if (arg == "--bench-update") {
+            runUpdateBenchmark();
+            return 0;
+        } else if (arg.compare(0, 18, "--dense-all-pairs=") == 0) {
+            denseFile = arg.substr(18);
+        } else if (arg == "--bench-dense") {
+            runDenseBenchmark();
+            return 0;
+        } else {
+            cout << "Usage: " << argv[0] << " [--pq=binary|radix|dial|delta] [--delta=W] [--all-pairs=FILE]"
+                 << " [--snapshot=FILE [--verify-snapshot]] [--write-snapshot=FILE] [--queries=FILE]"
+                 << " [--serve[=SOCKET]] [--load-test=SOCKET] [--batch=FILE [--threads=N]]"
+                 << " [--ch-build=FILE] [--route=FILE [--ch=FILE]] [--dense-all-pairs=FILE [--threads=N]]"
+                 << " [--bench-pq] [--bench-batch] [--bench-delta] [--bench-ch] [--bench-update] [--bench-dense]"
+                 << endl;
+            return 1;
         }
     }
-};
 
-int main() {
     Graph g;
+    g.setQueueKind(queueKind);
+    g.setDeltaWidth(deltaWidth);
+    g.setNumThreads(threads);
+
+    // With a snapshot the graph comes from the mapped file and only the
+    // query lines are read from text (edge lines there are ignored)
+    GraphSnapshot snapshot;
+    if (!snapshotFile.empty()) {
+        if (!snapshot.load(snapshotFile, verifySnapshot)) {
+            cout << "Error: " << snapshot.getError() << endl;
+            return 1;
+        }
+        g.attachSnapshot(snapshot);
+    }
     
-    ifstream inputFile("B2_input.txt");
-    if (!inputFile.is_open()) {
-        cout << "Error: Could not open B2_input.txt" << endl;
+    EdgeListFile inputFile;
+    if (!inputFile.load(queriesFile)) {
+        cout << "Error: Could not open " << queriesFile << endl;
         return 1;
     }
-    
-    string line;
+
+    if (snapshotFile.empty()) {
+        // Scratch names reuse their buffers, so only new cities allocate
+        string from, to;
+        const vector<EdgeRecord>& records = inputFile.getEdges();
+        for (int i = 0; i < (int)records.size(); i++) {
+            from.assign(records[i].from.data, records[i].from.length);
+            to.assign(records[i].to.data, records[i].to.length);
+            g.addEdge(from, to, records[i].weight);
+        }
+    }
     vector<CityPair> queries;
+    for (int i = 0; i < (int)inputFile.getQueries().size(); i++) {
+        const QueryRecord& q = inputFile.getQueries()[i];
+        queries.push_back(make_pair(q.from.str(), q.to.str()));
+    }
+    PathArena<VertexId> paths;  // every path below is written here
     
-    while (getline(inputFile, line)) {
-        if (line.empty()) continue;
-        
-        stringstream ss(line);
-        string token1, token2, token3;
-        
-        if (ss >> token1 >> token2 >> token3) {
-            char u = token1[0];
-            char v = token2[0];
-            int weight = stoi(token3);
-            g.addEdge(u, v, weight);
-        } else if (ss.str().find(' ') != string::npos) {
-            stringstream ss2(line);
-            char start, end;
-            if (ss2 >> start >> end) {
-                queries.push_back(make_pair(start, end));
-            }
-        }
-    }
-    inputFile.close();
-    
-    char capital = 'a';
+    if (!batchFile.empty()) {
+        // Lines "capital start end"; answers go to stdout in input order as
+        // "capital start end distance path" (-1 for no path or unknown city)
+        ifstream batchIn(batchFile.c_str());
+        if (!batchIn.is_open()) {
+            cout << "Error: Could not open " << batchFile << endl;
+            return 1;
+        }
+        vector<RouteQuery> batch;
+        vector<string> lines;
+        string capitalName, fromName, toName;
+        while (batchIn >> capitalName >> fromName >> toName) {
+            RouteQuery q;
+            q.capital = g.findVertex(capitalName);
+            q.from = g.findVertex(fromName);
+            q.to = g.findVertex(toName);
+            batch.push_back(q);
+            lines.push_back(capitalName + " " + fromName + " " + toName);
+        }
+        auto batchStart = high_resolution_clock::now();
+        vector<PathResult> answers = g.batchShortestPaths(batch, threads, paths);
+        auto batchEnd = high_resolution_clock::now();
+        for (int i = 0; i < (int)batch.size(); i++) {
+            cout << lines[i] << ' ' << answers[i].first;
+            if (answers[i].first != -1) {
+                cout << ' ';
+                g.printPath(answers[i].second);
+            }
+            cout << endl;
+        }
+        cerr << "Batch: " << batch.size() << " queries in " << duration_cast<microseconds>(batchEnd - batchStart).count()
+             << " microseconds on " << max(threads, 1) << " threads" << endl;
+        return 0;
+    }
+
+    if (!chBuildFile.empty()) {
+        ContractionHierarchy ch;
+        auto buildStart = high_resolution_clock::now();
+        ch.build(g);
+        long long buildTime = duration_cast<microseconds>(high_resolution_clock::now() - buildStart).count();
+        if (!ch.save(chBuildFile)) {
+            cout << "Error: Could not write " << chBuildFile << endl;
+            return 1;
+        }
+        cout << "Wrote contraction hierarchy " << chBuildFile << ": " << g.getNumNodes() << " nodes, "
+             << ch.getNumShortcuts() << " shortcuts, built in " << buildTime << " microseconds" << endl;
+        return 0;
+    }
+
+    if (!routeFile.empty()) {
+        // Lines "start end", answered directly rather than via the capital,
+        // as "start end distance path" (-1 for no path or unknown city).
+        // The index comes from --ch, or is built here when none is given.
+        ContractionHierarchy ch;
+        if (!chFile.empty()) {
+            string error;
+            if (!ch.load(chFile, g, error)) {
+                cout << "Error: " << error << endl;
+                return 1;
+            }
+        } else {
+            ch.build(g);
+        }
+        ifstream routeIn(routeFile.c_str());
+        if (!routeIn.is_open()) {
+            cout << "Error: Could not open " << routeFile << endl;
+            return 1;
+        }
+        LatencyStats latency;
+        string fromName, toName;
+        while (routeIn >> fromName >> toName) {
+            VertexId from = g.findVertex(fromName), to = g.findVertex(toName);
+            cout << fromName << ' ' << toName << ' ';
+            if (from == VertexDictionary::NOT_FOUND || to == VertexDictionary::NOT_FOUND) {
+                cout << -1 << endl;
+                continue;
+            }
+            paths.clear();
+            auto queryStart = high_resolution_clock::now();
+            PathResult answer = ch.query(from, to, paths);
+            latency.record(duration_cast<microseconds>(high_resolution_clock::now() - queryStart).count());
+            cout << answer.first;
+            if (answer.first != -1) {
+                cout << ' ';
+                g.printPath(answer.second);
+            }
+            cout << endl;
+        }
+        cerr << "Routes: " << latency.summary() << endl;
+        return 0;
+    }
+
+    string capital = "a";
+    VertexId capitalId = g.findVertex(capital);
+    if (capitalId == VertexDictionary::NOT_FOUND) {
+        cout << "Error: capital '" << capital << "' is not in the graph" << endl;
+        return 1;
+    }
+
+    if (!denseFile.empty()) {
+        // Every ordered pair of distinct cities as "u v viaCapital direct"
+        // (-1 for no path), both read off the same dense matrix
+        DenseAllPairs dense;
+        auto denseStart = high_resolution_clock::now();
+        if (!dense.build(g, threads)) {
+            cout << "Error: --dense-all-pairs handles at most " << DenseAllPairs::MAX_CITIES << " cities (this graph has "
+                 << g.getNumNodes() << ")" << endl;
+            return 1;
+        }
+        long long buildTime = duration_cast<microseconds>(high_resolution_clock::now() - denseStart).count();
+        ofstream pairsOut(denseFile.c_str());
+        if (!pairsOut.is_open()) {
+            cout << "Error: Could not write " << denseFile << endl;
+            return 1;
+        }
+        const VertexDictionary& dict = g.getDictionary();
+        for (VertexId u = 0; u < (VertexId)g.getNumNodes(); u++) {
+            for (VertexId v = 0; v < (VertexId)g.getNumNodes(); v++) {
+                if (u == v) continue;
+                pairsOut << dict.name(u) << ' ' << dict.name(v) << ' ' << dense.viaCapitalDistance(u, v, capitalId)
+                         << ' ' << dense.distance(u, v) << '\n';
+            }
+        }
+        cout << "Wrote dense all-pairs distances for " << g.getNumNodes() << " cities to " << denseFile
+             << ", matrices built in " << buildTime << " microseconds on " << max(threads, 1) << " threads" << endl;
+        return 0;
+    }
+
+    if (!writeSnapshotFile.empty()) {
+        if (!g.writeSnapshot(writeSnapshotFile, capitalId)) {
+            cout << "Error: Could not write " << writeSnapshotFile << endl;
+            return 1;
+        }
+        cout << "Wrote snapshot " << writeSnapshotFile << ": " << g.getNumNodes() << " nodes, "
+             << g.getOffsets()[g.getNumNodes()] << " directed edges, shortest-path tree from '" << capital << "'" << endl;
+        return 0;
+    }
+
+    if (serveStdin || !serveSocket.empty()) {
+        QueryServer server(g, capitalId);
+        if (serveStdin) {
+            server.serveStdin();
+        } else {
+            cout << "Serving " << g.getNumNodes() << " cities via capital '" << capital << "' on " << serveSocket << endl;
+            if (!server.serveSocket(serveSocket)) {
+                cout << "Error: Could not listen on " << serveSocket << " (the path must be unused or an old socket)" << endl;
+                return 1;
+            }
+        }
+        cerr << "Server stats: " << server.getStats().summary() << endl;
+        return 0;
+    }
+    if (!loadTestSocket.empty()) {
+        vector<string> names;
+        for (int i = 0; i < g.getNumNodes(); i++) names.push_back(g.getDictionary().name(i).str());
+        runLoadTest(loadTestSocket, names, 4, 20000);
+        return 0;
+    }
+
+    // Resolve query names to vertex ids once (unknown names stay NOT_FOUND)
+    vector<VertexPair> queryIds;
+    for (int i = 0; i < (int)queries.size(); i++) {
+        queryIds.push_back(make_pair(g.findVertex(queries[i].first), g.findVertex(queries[i].second)));
+    }
 
     cout << "=== ALGORITHM 1: O(n log n) - Visits Allowed ===" << endl;
     cout << "Graph has " << g.getNumNodes() << " nodes" << endl;
@@ -291,7 +3122,11 @@ int main() {
     vector<PathResult> results;
     for (int i = 0; i < (int)queries.size(); i++) {
         cout << "Computing path: " << queries[i].first << " -> " << capital << " -> " << queries[i].second << endl;
-        PathResult result = g.shortestPathViaCapital(queries[i].first, queries[i].second, capital);
+        if (queryIds[i].first == VertexDictionary::NOT_FOUND || queryIds[i].second == VertexDictionary::NOT_FOUND) {
+            results.push_back(make_pair(-1, VertexPath()));
+            continue;
+        }
+        PathResult result = g.shortestPathViaCapital(queryIds[i].first, queryIds[i].second, capitalId, paths);
         results.push_back(result);
     }
 
@@ -333,10 +3168,7 @@ int main() {
                 outputFile << endl;
             } else {
                 outputFile << "Shortest Path: ";
-                for (int j = 0; j < (int)results[i].second.size(); j++) {
-                    outputFile << results[i].second[j];
-                    if (j < (int)results[i].second.size() - 1) outputFile << ", ";
-                }
+                g.printPath(results[i].second, outputFile);
                 outputFile << endl;
                 outputFile << "Shortest Distance: " << results[i].first << endl;
                 outputFile << endl;
@@ -359,33 +3191,50 @@ int main() {
     cout << endl << "=== ALGORITHM 2: O(n^2) - No Revisits ===" << endl;
     cout << "Precomputing all pairs of cities via capital..." << endl;
 
-    PathMap allPairs = g.allPairsViaCapitalAlg2(capital);
+    long long pairCount;
+    if (allPairsFile.empty()) {
+        long long validPairs = 0;
+        pairCount = g.allPairsViaCapitalAlg2(capitalId, [&](VertexId, VertexId, int dist) {
+            if (dist != -1) validPairs++;
+        });
+    } else {
+        // Stream every pair straight to disk as "u v distance"
+        ofstream pairsOut(allPairsFile.c_str());
+        const VertexDictionary& dict = g.getDictionary();
+        pairCount = g.allPairsViaCapitalAlg2(capitalId, [&](VertexId u, VertexId v, int dist) {
+            pairsOut << dict.name(u) << ' ' << dict.name(v) << ' ' << dist << '\n';
+        });
+    }
 
     auto end2 = high_resolution_clock::now();
     auto duration2 = duration_cast<microseconds>(end2 - start2);
-    cout << "Computed paths for all " << allPairs.size() << " city pairs" << endl << endl;
+    cout << "Computed paths for all " << pairCount << " city pairs" << endl << endl;
 
     if (outputFile.is_open()) {
         outputFile << endl << "//** ALGORITHM 2: O(n^2) - No Revisits **//" << endl << endl;
     }
 
     for (int i = 0; i < (int)queries.size(); i++) {
-        PathMap::iterator it = allPairs.find(queries[i]);
-        if (it != allPairs.end()) {
+        VertexId u = queryIds[i].first;
+        VertexId v = queryIds[i].second;
+        if (u != VertexDictionary::NOT_FOUND && v != VertexDictionary::NOT_FOUND &&
+            u != v && u != capitalId && v != capitalId) {
+            PathResult result = g.shortestPathViaCapitalAlg2(u, v, capitalId, paths);
+
             cout << "//** Print out the shortest distance D and the shortest path from Source node "
                  << queries[i].first << " to Destination node " << queries[i].second
                  << " via node a (for example, " << queries[i].first << " --> " << queries[i].second
                  << "); **//" << endl;
             cout << endl;
 
-            if (it->second.first == -1) {
+            if (result.first == -1) {
                 cout << "No valid path (paths would overlap - violates no-revisit constraint)" << endl;
                 cout << endl;
             } else {
                 cout << "Shortest Path: ";
-                g.printPath(it->second.second);
+                g.printPath(result.second);
                 cout << endl;
-                cout << "Shortest Distance: " << it->second.first << endl;
+                cout << "Shortest Distance: " << result.first << endl;
                 cout << endl;
             }
 
@@ -396,17 +3245,14 @@ int main() {
                            << "); **//" << endl;
                 outputFile << endl;
 
-                if (it->second.first == -1) {
+                if (result.first == -1) {
                     outputFile << "No valid path (paths would overlap - violates no-revisit constraint)" << endl;
                     outputFile << endl;
                 } else {
                     outputFile << "Shortest Path: ";
-                    for (int j = 0; j < (int)it->second.second.size(); j++) {
-                        outputFile << it->second.second[j];
-                        if (j < (int)it->second.second.size() - 1) outputFile << ", ";
-                    }
+                    g.printPath(result.second, outputFile);
                     outputFile << endl;
-                    outputFile << "Shortest Distance: " << it->second.first << endl;
+                    outputFile << "Shortest Distance: " << result.first << endl;
                     outputFile << endl;
                 }
             }
@@ -423,6 +3269,76 @@ int main() {
         outputFile << endl;
     }
     
+    auto start3 = high_resolution_clock::now();
+
+    cout << endl << "=== ALGORITHM 3: Vertex-Disjoint Paths (Suurballe) - No Revisits ===" << endl;
+    cout << "Routing each query over two vertex-disjoint branches from the capital..." << endl << endl;
+
+    DisjointPathRouter router(g, capitalId);
+    vector<PathResult> disjointResults;
+    for (int i = 0; i < (int)queries.size(); i++) {
+        if (queryIds[i].first == VertexDictionary::NOT_FOUND || queryIds[i].second == VertexDictionary::NOT_FOUND) {
+            disjointResults.push_back(make_pair(-1, VertexPath()));
+            continue;
+        }
+        disjointResults.push_back(router.route(queryIds[i].first, queryIds[i].second, paths));
+    }
+
+    auto end3 = high_resolution_clock::now();
+    auto duration3 = duration_cast<microseconds>(end3 - start3);
+
+    if (outputFile.is_open()) {
+        outputFile << endl << "//** ALGORITHM 3: Vertex-Disjoint Paths (Suurballe) - No Revisits **//" << endl << endl;
+    }
+
+    for (int i = 0; i < (int)disjointResults.size(); i++) {
+        cout << "//** Print out the shortest distance D and the shortest path from Source node "
+             << queries[i].first << " to Destination node " << queries[i].second
+             << " via node a (for example, " << queries[i].first << " --> " << queries[i].second
+             << "); **//" << endl;
+        cout << endl;
+
+        if (disjointResults[i].first == -1) {
+            cout << "No valid path (no two vertex-disjoint routes through the capital)" << endl;
+            cout << endl;
+        } else {
+            cout << "Shortest Path: ";
+            g.printPath(disjointResults[i].second);
+            cout << endl;
+            cout << "Shortest Distance: " << disjointResults[i].first << endl;
+            cout << endl;
+        }
+
+        if (outputFile.is_open()) {
+            outputFile << "//** Print out the shortest distance D and the shortest path from Source node "
+                       << queries[i].first << " to Destination node " << queries[i].second
+                       << " via node a (for example, " << queries[i].first << " --> " << queries[i].second
+                       << "); **//" << endl;
+            outputFile << endl;
+
+            if (disjointResults[i].first == -1) {
+                outputFile << "No valid path (no two vertex-disjoint routes through the capital)" << endl;
+                outputFile << endl;
+            } else {
+                outputFile << "Shortest Path: ";
+                g.printPath(disjointResults[i].second, outputFile);
+                outputFile << endl;
+                outputFile << "Shortest Distance: " << disjointResults[i].first << endl;
+                outputFile << endl;
+            }
+        }
+    }
+
+    cout << "//** print out running time **//" << endl;
+    cout << "Running-time: " << duration3.count() << " microseconds" << endl;
+    cout << endl;
+
+    if (outputFile.is_open()) {
+        outputFile << "//** print out running time **//" << endl;
+        outputFile << "Running-time: " << duration3.count() << " microseconds" << endl;
+        outputFile << endl;
+    }
+    
     if (outputFile.is_open()) {
         outputFile.close();
     }
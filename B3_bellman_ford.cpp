@@ -1,125 +1,1200 @@
 #include <iostream>
 #include <vector>
 #include <climits>
+#include <cstdlib>
 #include <map>
+#include <queue>
+#include <algorithm>
 #include <chrono>
+#include <random>
 #include <fstream>
-#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "edge_loader.h"
+#include "graph_snapshot.h"
+#include "path_arena.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 using namespace std;
 using namespace std::chrono;
 
-struct Edge {
-    char from, to;
-    int weight;
+typedef PathView<char> CityPath;          // city names owned by a PathArena<char>
+typedef pair<int, CityPath> PathResult;   // (distance, path)
+
+// Shortest-path tree from one source: distances and parent pointers
+// (both empty if a negative cycle was found)
+struct ShortestPathTree {
+    vector<int> dist;
+    vector<int> parent;
+    vector<int> hops;  // edges on the tree path from the start
+};
+
+// Capital tree kept by the online mode across edge insertions. Tree
+// vertices are threaded in preorder (a circular list from the root), so the
+// subtree of v is v followed by the run of deeper vertices after it.
+// Vertices outside the tree have prev == next == -1.
+struct OnlineTree {
+    int root;        // -1 until started, or after the graph changed otherwise
+    char capital;
+    vector<int> dist;
+    vector<int> parent;
+    vector<int> depth;
+    vector<int> prev;
+    vector<int> next;
+    vector<vector<pair<int, int> > > out;  // (target, weight) per vertex
+    vector<char> queued;
+};
+
+// One vertex's online fields before a change, for rolling an insert back
+struct OnlineChange {
+    int vertex, dist, parent, depth, prev, next;
+};
+
+// Which relaxation strategy bellmanFordWithParents uses
+enum BellmanFordKind {
+    SWEEP,  // classic rounds over every edge, stopping once a round changes nothing
+    SPFA,   // queue-based: only relax edges out of vertices whose distance changed
+    PARALLEL_JACOBI  // multithreaded rounds, each thread owns a block of destinations
+};
+
+// Work done by the last Bellman-Ford run, compared with a full V-1 round run
+struct RelaxationStats {
+    int rounds;               // sweeps over the edge list (queue passes for SPFA)
+    long long edgeChecks;     // edges examined
+    long long fullEdgeChecks; // edges a full V-1 round run plus the cycle check examines
+};
 
-    Edge(char from, char to, int weight) {
-        this->from = from;
-        this->to = to;
-        this->weight = weight;
+// Reusable barrier so the relaxation threads can finish a round together
+class RoundBarrier {
+private:
+    mutex m;
+    condition_variable cv;
+    int threads;
+    int waiting;
+    int generation;
+
+public:
+    explicit RoundBarrier(int threads) {
+        this->threads = threads;
+        waiting = 0;
+        generation = 0;
+    }
+
+    void wait() {
+        unique_lock<mutex> lock(m);
+        int gen = generation;
+        if (++waiting == threads) {
+            waiting = 0;
+            generation++;
+            cv.notify_all();
+        } else {
+            cv.wait(lock, [&] { return gen != generation; });
+        }
     }
 };
 
+// One Jacobi step for destinations [first, last): every vertex takes the best
+// of its in-edges against the previous round's distances (cur) and writes
+// the result to next. The first in-edge reaching the minimum becomes the
+// parent, so the result does not depend on how vertices are split between
+// threads. Returns true if any distance dropped.
+static bool relaxDestinationBlock(int first, int last, const int* inOffsets, const int* inFrom,
+                                  const int* inWeight, const int* cur, int* next, int* parent) {
+    bool changed = false;
+    for (int v = first; v < last; v++) {
+        int best = cur[v];
+        int bestParent = -1;
+        int k = inOffsets[v];
+        int end = inOffsets[v + 1];
+
+#ifdef __AVX2__
+        // Eight in-edges at a time: gather the sources' distances, add the
+        // weights (skipping unreachable sources) and keep a running minimum
+        const __m256i inf = _mm256_set1_epi32(INT_MAX);
+        __m256i minVec = inf;
+        int vecEnd = k + (end - k) / 8 * 8;
+        for (int j = k; j < vecEnd; j += 8) {
+            __m256i src = _mm256_loadu_si256((const __m256i*)(inFrom + j));
+            __m256i d = _mm256_i32gather_epi32(cur, src, 4);
+            __m256i w = _mm256_loadu_si256((const __m256i*)(inWeight + j));
+            __m256i unreachable = _mm256_cmpeq_epi32(d, inf);
+            __m256i cand = _mm256_blendv_epi8(_mm256_add_epi32(d, w), inf, unreachable);
+            minVec = _mm256_min_epi32(minVec, cand);
+        }
+        int lanes[8];
+        _mm256_storeu_si256((__m256i*)lanes, minVec);
+        int vecMin = INT_MAX;
+        for (int i = 0; i < 8; i++) {
+            if (lanes[i] < vecMin) vecMin = lanes[i];
+        }
+        if (vecMin < best) {
+            // Rescan for the first edge that reaches the minimum
+            for (int j = k; j < vecEnd; j++) {
+                int du = cur[inFrom[j]];
+                if (du != INT_MAX && du + inWeight[j] == vecMin) {
+                    best = vecMin;
+                    bestParent = inFrom[j];
+                    break;
+                }
+            }
+        }
+        k = vecEnd;
+#endif
+
+        for (; k < end; k++) {
+            int du = cur[inFrom[k]];
+            if (du != INT_MAX && du + inWeight[k] < best) {
+                best = du + inWeight[k];
+                bestParent = inFrom[k];
+            }
+        }
+
+        next[v] = best;
+        if (bestParent != -1) {
+            parent[v] = bestParent;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Which in-edge kernel relaxDestinationBlock uses in this build
+string relaxKernelName() {
+#ifdef __AVX2__
+    return "AVX2 gather";
+#else
+    return "scalar (build with make SIMD=1 for AVX2)";
+#endif
+}
+
 class BellmanFordGraph {
 private:
-    vector<Edge> edges;
+    // Directed edges as structure-of-arrays with endpoints already resolved
+    // to vertex indices, so the relaxation loop does no lookups
+    vector<int> edgeFrom;
+    vector<int> edgeTo;
+    vector<int> edgeWeight;
+    vector<int> outOffsets;  // edges leaving u are outEdges[outOffsets[u] .. outOffsets[u+1]-1]
+    vector<int> outEdges;    // (built on demand for SPFA)
+    vector<int> inOffsets;   // edges entering v are inFrom/inWeight[inOffsets[v] .. inOffsets[v+1]-1]
+    vector<int> inFrom;      // (built on demand for the parallel engine)
+    vector<int> inWeight;
+    int numThreads;
     map<char, int> nodeIndex;
     vector<char> indexToNode;
     int numNodes;
+    map<char, ShortestPathTree> treeCache;  // one tree per capital, cleared by addEdge,
+                                            // repaired by updateEdgeWeight / removeEdge
+    BellmanFordKind kind;
+
+    // Johnson mode: vertex potentials from one Bellman-Ford run, then cached
+    // Dijkstra trees on the reweighted graph (all cleared by addEdge)
+    vector<int> potential;
+    vector<int> negativeCycle;  // vertex indices around the cycle, first == last
+    bool potentialsReady;
+    map<char, ShortestPathTree> johnsonForward;  // capital -> v, parent pointers
+    map<char, ShortestPathTree> johnsonReverse;  // v -> capital, next-hop pointers
+    RelaxationStats lastStats;
+    OnlineTree online;
+    vector<OnlineChange> onlineUndo;
+
+    // Group edge indices by source vertex for SPFA (counting sort, stable)
+    void buildOutEdges() {
+        outOffsets.assign(numNodes + 1, 0);
+        for (int j = 0; j < (int)edgeFrom.size(); j++) {
+            outOffsets[edgeFrom[j] + 1]++;
+        }
+        for (int u = 0; u < numNodes; u++) {
+            outOffsets[u + 1] += outOffsets[u];
+        }
+        outEdges.resize(edgeFrom.size());
+        vector<int> next(outOffsets.begin(), outOffsets.end() - 1);
+        for (int j = 0; j < (int)edgeFrom.size(); j++) {
+            outEdges[next[edgeFrom[j]]++] = j;
+        }
+    }
+
+    // Classic Bellman-Ford, but a round that changes nothing ends the run:
+    // no later round could change anything either, and no negative cycle
+    // is reachable from the start
+    bool sweepRelax(vector<int>& dist, vector<int>& parent) {
+        const int* from = edgeFrom.data();
+        const int* to = edgeTo.data();
+        const int* weight = edgeWeight.data();
+        int m = (int)edgeFrom.size();
+
+        for (int i = 0; i < numNodes - 1; i++) {
+            bool changed = false;
+            lastStats.rounds++;
+            lastStats.edgeChecks += m;
+            for (int j = 0; j < m; j++) {
+                int u = from[j];
+                int v = to[j];
+
+                if (dist[u] != INT_MAX && dist[u] + weight[j] < dist[v]) {
+                    dist[v] = dist[u] + weight[j];
+                    parent[v] = u;
+                    changed = true;
+                }
+            }
+            if (!changed) return true;
+        }
+
+        lastStats.edgeChecks += m;
+        for (int j = 0; j < m; j++) {
+            int u = from[j];
+            int v = to[j];
+
+            if (dist[u] != INT_MAX && dist[u] + weight[j] < dist[v]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Group edges by destination for the parallel engine (counting sort, stable)
+    void buildInEdges() {
+        inOffsets.assign(numNodes + 1, 0);
+        for (int j = 0; j < (int)edgeTo.size(); j++) {
+            inOffsets[edgeTo[j] + 1]++;
+        }
+        for (int v = 0; v < numNodes; v++) {
+            inOffsets[v + 1] += inOffsets[v];
+        }
+        inFrom.resize(edgeTo.size());
+        inWeight.resize(edgeTo.size());
+        vector<int> next(inOffsets.begin(), inOffsets.end() - 1);
+        for (int j = 0; j < (int)edgeTo.size(); j++) {
+            int k = next[edgeTo[j]]++;
+            inFrom[k] = edgeFrom[j];
+            inWeight[k] = edgeWeight[j];
+        }
+    }
+
+    // Jacobi-style Bellman-Ford on a pool of threads. Vertices are split into
+    // contiguous destination blocks with about the same number of in-edges,
+    // so each thread writes only its own slice of the distance and parent
+    // arrays and no locking is needed inside a round. Round k finds every
+    // shortest path of at most k edges, so if round V still lowers a
+    // distance there is a negative cycle.
+    bool parallelRelax(vector<int>& dist, vector<int>& parent) {
+        if ((int)inOffsets.size() != numNodes + 1) buildInEdges();
+        int threads = numThreads;
+        if (threads > numNodes) threads = numNodes;
+        if (threads < 1) threads = 1;
+
+        vector<int> blockStart(threads + 1, numNodes);
+        blockStart[0] = 0;
+        long long m = inFrom.size();
+        for (int t = 1, v = 0; t < threads; t++) {
+            while (v < numNodes && (long long)inOffsets[v] * threads < m * t) v++;
+            blockStart[t] = v;
+        }
+
+        vector<int> other(dist);
+        int* cur = dist.data();
+        int* next = other.data();
+        vector<char> changed(threads, 0);
+        bool done = false;
+        bool negativeCycle = false;
+        RoundBarrier barrier(threads);
+
+        auto worker = [&](int t) {
+            while (true) {
+                changed[t] = relaxDestinationBlock(blockStart[t], blockStart[t + 1], inOffsets.data(),
+                                                   inFrom.data(), inWeight.data(), cur, next, parent.data());
+                barrier.wait();
+                if (t == 0) {
+                    bool any = false;
+                    for (int i = 0; i < threads; i++) any = any || changed[i];
+                    swap(cur, next);
+                    lastStats.rounds++;
+                    lastStats.edgeChecks += m;
+                    if (!any) {
+                        done = true;
+                    } else if (lastStats.rounds >= numNodes) {
+                        negativeCycle = true;
+                        done = true;
+                    }
+                }
+                barrier.wait();
+                if (done) break;
+            }
+        };
+
+        vector<thread> pool;
+        for (int t = 1; t < threads; t++) {
+            pool.push_back(thread(worker, t));
+        }
+        worker(0);
+        for (int t = 0; t < (int)pool.size(); t++) {
+            pool[t].join();
+        }
+
+        if (cur != dist.data()) dist.swap(other);
+        return !negativeCycle;
+    }
+
+    // A cycle in the parent pointers, in edge direction with first == last,
+    // or empty if they form a forest. Every such cycle is negative: each
+    // parent edge was tight when set and the distances only drop afterwards.
+    vector<int> findParentCycle(const vector<int>& parent) const {
+        vector<int> walk(numNodes, -1);  // which start's walk first reached the vertex
+        for (int s = 0; s < numNodes; s++) {
+            int v = s;
+            while (v != -1 && walk[v] == -1) {
+                walk[v] = s;
+                v = parent[v];
+            }
+            if (v == -1 || walk[v] != s) continue;
+
+            // v is on a cycle of this walk; parents point backwards along it
+            vector<int> cycle;
+            int curr = v;
+            do {
+                cycle.push_back(curr);
+                curr = parent[curr];
+            } while (curr != v);
+            cycle.push_back(v);
+            reverse(cycle.begin(), cycle.end());
+            return cycle;
+        }
+        return vector<int>();
+    }
+
+    // Dijkstra on the Johnson-reweighted graph, where w(u,v) + h[u] - h[v]
+    // is never negative. The forward tree holds capital -> v distances and
+    // parent pointers; the reverse tree follows in-edges and holds v ->
+    // capital distances with next-hop pointers toward the capital. Distances
+    // are converted back to the original weights before returning.
+    ShortestPathTree johnsonDijkstra(int sourceIdx, bool reverse) {
+        if ((int)outOffsets.size() != numNodes + 1) buildOutEdges();
+        if ((int)inOffsets.size() != numNodes + 1) buildInEdges();
+        const vector<int>& h = potential;
+
+        ShortestPathTree tree;
+        tree.dist.assign(numNodes, INT_MAX);
+        tree.parent.assign(numNodes, -1);
+        priority_queue<pair<int, int>, vector<pair<int, int> >, greater<pair<int, int> > > pq;
+        tree.dist[sourceIdx] = 0;
+        pq.push(make_pair(0, sourceIdx));
+
+        while (!pq.empty()) {
+            int d = pq.top().first;
+            int x = pq.top().second;
+            pq.pop();
+            if (d > tree.dist[x]) continue;
+
+            if (!reverse) {
+                for (int k = outOffsets[x]; k < outOffsets[x + 1]; k++) {
+                    int j = outEdges[k];
+                    int y = edgeTo[j];
+                    int newDist = d + edgeWeight[j] + h[x] - h[y];
+                    if (newDist < tree.dist[y]) {
+                        tree.dist[y] = newDist;
+                        tree.parent[y] = x;
+                        pq.push(make_pair(newDist, y));
+                    }
+                }
+            } else {
+                for (int k = inOffsets[x]; k < inOffsets[x + 1]; k++) {
+                    int y = inFrom[k];
+                    int newDist = d + inWeight[k] + h[y] - h[x];
+                    if (newDist < tree.dist[y]) {
+                        tree.dist[y] = newDist;
+                        tree.parent[y] = x;
+                        pq.push(make_pair(newDist, y));
+                    }
+                }
+            }
+        }
+
+        for (int v = 0; v < numNodes; v++) {
+            if (tree.dist[v] == INT_MAX) continue;
+            tree.dist[v] += reverse ? h[sourceIdx] - h[v] : h[v] - h[sourceIdx];
+        }
+        return tree;
+    }
+
+    // SPFA: a FIFO queue of vertices whose distance dropped, starting with
+    // every vertex that already has a distance. A shortest path never needs
+    // more than V-1 edges, so a vertex whose path reaches V edges means a
+    // negative cycle.
+    bool queueRelax(vector<int>& dist, vector<int>& parent) {
+        if ((int)outOffsets.size() != numNodes + 1) buildOutEdges();
+        vector<int> pathEdges(numNodes, 0);
+        vector<bool> inQueue(numNodes, false);
+        queue<int> q;
+        for (int v = 0; v < numNodes; v++) {
+            if (dist[v] != INT_MAX) {
+                q.push(v);
+                inQueue[v] = true;
+            }
+        }
+
+        while (!q.empty()) {
+            int u = q.front();
+            q.pop();
+            inQueue[u] = false;
+            lastStats.rounds++;
+
+            for (int k = outOffsets[u]; k < outOffsets[u + 1]; k++) {
+                int j = outEdges[k];
+                int v = edgeTo[j];
+                lastStats.edgeChecks++;
+
+                if (dist[u] + edgeWeight[j] < dist[v]) {
+                    dist[v] = dist[u] + edgeWeight[j];
+                    parent[v] = u;
+                    pathEdges[v] = pathEdges[u] + 1;
+                    if (pathEdges[v] >= numNodes) return false;
+                    if (!inQueue[v]) {
+                        q.push(v);
+                        inQueue[v] = true;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // Queue-based relaxation from whatever is already queued, on top of the
+    // distances already in the tree. pathEdges holds the edge count of the
+    // path behind each distance; as in queueRelax, a path reaching V edges
+    // repeats a vertex, so it means a negative cycle and returns false.
+    bool relaxQueued(queue<int>& q, vector<bool>& inQueue, vector<int>& dist, vector<int>& parent,
+                     vector<int>& pathEdges) {
+        while (!q.empty()) {
+            int u = q.front();
+            q.pop();
+            inQueue[u] = false;
+            for (int k = outOffsets[u]; k < outOffsets[u + 1]; k++) {
+                int j = outEdges[k];
+                int v = edgeTo[j];
+                if (dist[u] + edgeWeight[j] < dist[v]) {
+                    dist[v] = dist[u] + edgeWeight[j];
+                    parent[v] = u;
+                    pathEdges[v] = pathEdges[u] + 1;
+                    if (pathEdges[v] >= numNodes) return false;
+                    if (!inQueue[v]) {
+                        q.push(v);
+                        inQueue[v] = true;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // Parent rule every engine ends with, so a tree does not depend on the
+    // engine, the thread count or on having been repaired. A BFS from the
+    // start over tight edges (dist[u] + w == dist[v]) gives every vertex
+    // the fewest edges of any shortest path to it, and v takes the first
+    // in-edge from a vertex one edge closer. Counting edges keeps the
+    // parents acyclic even along zero and negative weights.
+    void tightParents(int startIdx, const vector<int>& dist, vector<int>& parent, vector<int>& hops) {
+        if ((int)outOffsets.size() != numNodes + 1) buildOutEdges();
+        if ((int)inOffsets.size() != numNodes + 1) buildInEdges();
+        parent.assign(numNodes, -1);
+        hops.assign(numNodes, -1);
+        vector<int> order(1, startIdx);
+        hops[startIdx] = 0;
+        for (size_t head = 0; head < order.size(); head++) {
+            int u = order[head];
+            for (int k = outOffsets[u]; k < outOffsets[u + 1]; k++) {
+                int j = outEdges[k];
+                int v = edgeTo[j];
+                if (hops[v] == -1 && dist[u] + edgeWeight[j] == dist[v]) {
+                    hops[v] = hops[u] + 1;
+                    order.push_back(v);
+                }
+            }
+        }
+        for (size_t i = 1; i < order.size(); i++) {
+            int v = order[i];
+            for (int k = inOffsets[v]; k < inOffsets[v + 1]; k++) {
+                int u = inFrom[k];
+                if (hops[u] == hops[v] - 1 && dist[u] + inWeight[k] == dist[v]) {
+                    parent[v] = u;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Bring capital's cached tree up to date after edge a -> b went from
+    // oldWeight to newWeight (removed = the edge is gone), relaxing only
+    // what can change:
+    // - Lower weight: if it now improves b, relax onward from b alone.
+    // - Higher weight or removed, on the tree: the subtree below b is
+    //   invalidated. Each of its vertices restarts from its best in-edge
+    //   from outside the subtree, and relaxation within the subtree settles
+    //   the rest. Nothing outside it can get shorter.
+    // A new tie or a changed distance can move the fewest-edge paths
+    // anywhere below it, so parents are then re-derived with tightParents,
+    // one pass over the edges instead of Bellman-Ford's rounds, and the
+    // tree equals a full rerun. Returns false if the change closed a
+    // negative cycle through the capital's reach, in which case the caller
+    // drops the tree.
+    bool repairTree(ShortestPathTree& tree, int capital, int a, int b, int oldWeight, int newWeight, bool removed) {
+        vector<int>& dist = tree.dist;
+        vector<int>& parent = tree.parent;
+        vector<int>& pathEdges = tree.hops;
+        queue<int> q;
+        vector<bool> inQueue(numNodes, false);
+
+        if (!removed && newWeight < oldWeight) {
+            if (dist[a] == INT_MAX || dist[a] + newWeight > dist[b]) return true;
+            if (dist[a] + newWeight < dist[b]) {
+                dist[b] = dist[a] + newWeight;
+                parent[b] = a;
+                pathEdges[b] = pathEdges[a] + 1;
+                if (pathEdges[b] >= numNodes) return false;
+                q.push(b);
+                inQueue[b] = true;
+            }
+        } else {
+            // Off the tree nothing changes: b's parent and path length came
+            // from another in-edge, which is still there
+            if (parent[b] != a || dist[a] == INT_MAX || dist[b] != dist[a] + oldWeight) return true;
+
+            // Collect the subtree; INT_MAX marks a vertex as collected
+            vector<int> subtree(1, b);
+            dist[b] = INT_MAX;
+            for (size_t i = 0; i < subtree.size(); i++) {
+                int x = subtree[i];
+                for (int k = outOffsets[x]; k < outOffsets[x + 1]; k++) {
+                    int y = edgeTo[outEdges[k]];
+                    if (parent[y] == x && dist[y] != INT_MAX) {
+                        dist[y] = INT_MAX;
+                        subtree.push_back(y);
+                    }
+                }
+            }
+            for (size_t i = 0; i < subtree.size(); i++) {
+                int x = subtree[i];
+                parent[x] = -1;
+                for (int k = inOffsets[x]; k < inOffsets[x + 1]; k++) {
+                    int dy = dist[inFrom[k]];
+                    if (dy != INT_MAX && dy + inWeight[k] < dist[x]) {
+                        dist[x] = dy + inWeight[k];
+                        parent[x] = inFrom[k];
+                        pathEdges[x] = pathEdges[inFrom[k]] + 1;
+                    }
+                }
+                if (dist[x] != INT_MAX) {
+                    q.push(x);
+                    inQueue[x] = true;
+                }
+            }
+        }
+        if (!relaxQueued(q, inQueue, dist, parent, pathEdges)) return false;
+        tightParents(capital, dist, parent, pathEdges);
+        return true;
+    }
+
+    // Change (or remove) the first directed edge u -> v and repair the
+    // cached trees. Johnson potentials and trees are simply recomputed on
+    // next use.
+    bool changeDirectedEdge(int u, int v, int newWeight, bool removed) {
+        if ((int)outOffsets.size() != numNodes + 1) buildOutEdges();
+        int j = -1;
+        for (int k = outOffsets[u]; k < outOffsets[u + 1] && j == -1; k++) {
+            if (edgeTo[outEdges[k]] == v) j = outEdges[k];
+        }
+        if (j == -1) return false;
+        int oldWeight = edgeWeight[j];
+        online.root = -1;
+
+        if (removed) {
+            edgeFrom.erase(edgeFrom.begin() + j);
+            edgeTo.erase(edgeTo.begin() + j);
+            edgeWeight.erase(edgeWeight.begin() + j);
+            buildOutEdges();
+            inOffsets.clear();
+        } else {
+            edgeWeight[j] = newWeight;
+            if ((int)inOffsets.size() == numNodes + 1) {
+                // In-lists keep edge order too, so this is the first u entry in v's list
+                for (int k = inOffsets[v]; k < inOffsets[v + 1]; k++) {
+                    if (inFrom[k] == u) {
+                        inWeight[k] = newWeight;
+                        break;
+                    }
+                }
+            }
+        }
+        if ((int)inOffsets.size() != numNodes + 1) buildInEdges();
+        potentialsReady = false;
+        johnsonForward.clear();
+        johnsonReverse.clear();
+
+        for (map<char, ShortestPathTree>::iterator it = treeCache.begin(); it != treeCache.end();) {
+            // An empty tree recorded a negative cycle, which the change may have broken
+            if (it->second.dist.empty() ||
+                !repairTree(it->second, nodeIndex[it->first], u, v, oldWeight, newWeight, removed)) {
+                treeCache.erase(it++);
+            } else {
+                ++it;
+            }
+        }
+        return true;
+    }
+
+    // Both directions of a two-way road, as addEdge created them
+    bool changeRoad(char u, char v, int newWeight, bool removed) {
+        map<char, int>::const_iterator a = nodeIndex.find(u), b = nodeIndex.find(v);
+        if (a == nodeIndex.end() || b == nodeIndex.end() || !hasDirectedEdge(a->second, b->second) ||
+            !hasDirectedEdge(b->second, a->second)) {
+            return false;
+        }
+        changeDirectedEdge(a->second, b->second, newWeight, removed);
+        if (a->second != b->second) changeDirectedEdge(b->second, a->second, newWeight, removed);
+        return true;
+    }
+
+    bool hasDirectedEdge(int u, int v) {
+        if ((int)outOffsets.size() != numNodes + 1) buildOutEdges();
+        for (int k = outOffsets[u]; k < outOffsets[u + 1]; k++) {
+            if (edgeTo[outEdges[k]] == v) return true;
+        }
+        return false;
+    }
+
+    // Online mode helpers. Every field change goes through onlineSave first,
+    // so replaying onlineUndo backwards restores the tree exactly.
+    void onlineSave(int x) {
+        OnlineChange c = {x, online.dist[x], online.parent[x], online.depth[x], online.prev[x], online.next[x]};
+        onlineUndo.push_back(c);
+    }
+
+    void onlineUnlink(int x) {
+        int p = online.prev[x], q = online.next[x];
+        onlineSave(x);
+        onlineSave(p);
+        onlineSave(q);
+        online.next[p] = q;
+        online.prev[q] = p;
+        online.prev[x] = online.next[x] = online.depth[x] = -1;
+    }
+
+    void onlineLinkAfter(int x, int p) {
+        int q = online.next[p];
+        onlineSave(x);
+        onlineSave(p);
+        onlineSave(q);
+        online.prev[x] = p;
+        online.next[x] = q;
+        online.next[p] = x;
+        online.prev[q] = x;
+        online.depth[x] = online.depth[p] + 1;
+    }
+
+    // Subtree disassembly: y's distance is about to drop, so everything
+    // below it is stale and leaves the tree (labels kept as upper bounds;
+    // they are lowered again once y is scanned). If the vertex whose edge
+    // lowers y is itself below y, that edge closes a negative cycle:
+    // returns false and leaves the rest of the subtree in place.
+    bool onlineDetachSubtree(int y, int tail) {
+        int z = online.next[y];
+        while (z != online.root && online.depth[z] > online.depth[y]) {
+            if (z == tail) return false;
+            int after = online.next[z];
+            onlineUnlink(z);
+            z = after;
+        }
+        return true;
+    }
+
+    // Relax x -> y during an online insert; false if it closes a negative cycle
+    bool onlineRelax(int x, int y, int weight, queue<int>& q, vector<int>& touched) {
+        int newDist = online.dist[x] + weight;
+        if (newDist >= online.dist[y]) return true;
+        if (y == x) return false;
+        if (online.prev[y] != -1) {
+            if (!onlineDetachSubtree(y, x)) return false;
+            onlineUnlink(y);
+        }
+        onlineSave(y);
+        online.dist[y] = newDist;
+        online.parent[y] = x;
+        onlineLinkAfter(y, x);
+        if (!online.queued[y]) {
+            online.queued[y] = 1;
+            touched.push_back(y);
+            q.push(y);
+        }
+        return true;
+    }
+
+    void addVertex(char name) {
+        nodeIndex[name] = numNodes++;
+        indexToNode.push_back(name);
+        if (online.root != -1) {
+            online.dist.push_back(INT_MAX);
+            online.parent.push_back(-1);
+            online.depth.push_back(-1);
+            online.prev.push_back(-1);
+            online.next.push_back(-1);
+            online.out.push_back(vector<pair<int, int> >());
+            online.queued.push_back(0);
+        }
+    }
     
 public:
     BellmanFordGraph() {
         numNodes = 0;
+        kind = SWEEP;
+        potentialsReady = false;
+        numThreads = thread::hardware_concurrency();
+        if (numThreads < 1) numThreads = 1;
+        lastStats.rounds = 0;
+        lastStats.edgeChecks = 0;
+        lastStats.fullEdgeChecks = 0;
+        online.root = -1;
+        online.capital = 0;
     }
     
     void addEdge(char u, char v, int weight) {
-        if (nodeIndex.find(u) == nodeIndex.end()) {
-            nodeIndex[u] = numNodes++;
-            indexToNode.push_back(u);
-        }
-        if (nodeIndex.find(v) == nodeIndex.end()) {
-            nodeIndex[v] = numNodes++;
-            indexToNode.push_back(v);
-        }
+        if (nodeIndex.find(u) == nodeIndex.end()) addVertex(u);
+        if (nodeIndex.find(v) == nodeIndex.end()) addVertex(v);
+        online.root = -1;
         
-        edges.push_back(Edge(u, v, weight));
-        edges.push_back(Edge(v, u, weight));
+        int uIdx = nodeIndex[u];
+        int vIdx = nodeIndex[v];
+        edgeFrom.push_back(uIdx);
+        edgeTo.push_back(vIdx);
+        edgeWeight.push_back(weight);
+        edgeFrom.push_back(vIdx);
+        edgeTo.push_back(uIdx);
+        edgeWeight.push_back(weight);
+        outOffsets.clear();
+        inOffsets.clear();
+        potentialsReady = false;
+        johnsonForward.clear();
+        johnsonReverse.clear();
+
+        // Any new edge can change shortest paths, so drop cached trees
+        treeCache.clear();
     }
     
-    int getNumNodes() const { return numNodes; }
-    int getNumEdges() const { return edges.size(); }
-    
-    pair<vector<int>, vector<int> > bellmanFordWithParents(char start) {
-        vector<int> dist(numNodes, INT_MAX);
-        vector<int> parent(numNodes, -1);
-        int startIdx = nodeIndex.find(start)->second;
-        dist[startIdx] = 0;
+    // One-way edge (addEdge adds both directions). Negative weights only make
+    // sense on one-way edges: a negative two-way edge is already a cycle.
+    void addDirectedEdge(char u, char v, int weight) {
+        if (nodeIndex.find(u) == nodeIndex.end()) addVertex(u);
+        if (nodeIndex.find(v) == nodeIndex.end()) addVertex(v);
+        online.root = -1;
 
-        for (int i = 0; i < numNodes - 1; i++) {
-            for (int j = 0; j < (int)edges.size(); j++) {
-                Edge edge = edges[j];
-                int u = nodeIndex.find(edge.from)->second;
-                int v = nodeIndex.find(edge.to)->second;
+        edgeFrom.push_back(nodeIndex[u]);
+        edgeTo.push_back(nodeIndex[v]);
+        edgeWeight.push_back(weight);
+        outOffsets.clear();
+        inOffsets.clear();
+        potentialsReady = false;
+        johnsonForward.clear();
+        johnsonReverse.clear();
+        treeCache.clear();
+    }
 
-                if (dist[u] != INT_MAX && dist[u] + edge.weight < dist[v]) {
-                    dist[v] = dist[u] + edge.weight;
-                    parent[v] = u;
+    // Change the weight of the two-way road u - v (both directions, the
+    // first of each if there are parallel edges). Cached trees are repaired
+    // rather than dropped. Returns false if there is no such road.
+    bool updateEdgeWeight(char u, char v, int weight) {
+        return changeRoad(u, v, weight, false);
+    }
+
+    // Remove the two-way road u - v; the cities stay
+    bool removeEdge(char u, char v) {
+        return changeRoad(u, v, 0, true);
+    }
+
+    // One-way versions, for edges added with addDirectedEdge
+    bool updateDirectedEdgeWeight(char u, char v, int weight) {
+        map<char, int>::const_iterator a = nodeIndex.find(u), b = nodeIndex.find(v);
+        if (a == nodeIndex.end() || b == nodeIndex.end()) return false;
+        return changeDirectedEdge(a->second, b->second, weight, false);
+    }
+
+    bool removeDirectedEdge(char u, char v) {
+        map<char, int>::const_iterator a = nodeIndex.find(u), b = nodeIndex.find(v);
+        if (a == nodeIndex.end() || b == nodeIndex.end()) return false;
+        return changeDirectedEdge(a->second, b->second, 0, true);
+    }
+
+    // Online mode: start from a full Bellman-Ford tree for capital, then
+    // insertEdgeOnline keeps it current one edge at a time. Returns false if
+    // a negative cycle is already reachable from the capital.
+    bool startOnline(char capital) {
+        online.root = -1;
+        online.capital = capital;
+        if (nodeIndex.find(capital) == nodeIndex.end()) addVertex(capital);
+        pair<vector<int>, vector<int> > result = bellmanFordWithParents(capital);
+        if (result.first.empty()) return false;
+
+        int n = numNodes, root = nodeIndex[capital];
+        online.dist.swap(result.first);
+        online.parent.swap(result.second);
+        online.depth.assign(n, -1);
+        online.prev.assign(n, -1);
+        online.next.assign(n, -1);
+        online.queued.assign(n, 0);
+        online.out.assign(n, vector<pair<int, int> >());
+        for (int j = 0; j < (int)edgeFrom.size(); j++) {
+            online.out[edgeFrom[j]].push_back(make_pair(edgeTo[j], edgeWeight[j]));
+        }
+
+        // Thread the tree in preorder with an explicit stack
+        vector<vector<int> > children(n);
+        for (int v = 0; v < n; v++) {
+            if (v != root && online.parent[v] != -1) children[online.parent[v]].push_back(v);
+        }
+        vector<int> stack(1, root);
+        int last = root;
+        online.depth[root] = 0;
+        online.prev[root] = online.next[root] = root;
+        while (!stack.empty()) {
+            int x = stack.back();
+            stack.pop_back();
+            if (x != root) {
+                online.depth[x] = online.depth[online.parent[x]] + 1;
+                online.prev[x] = last;
+                online.next[last] = x;
+                last = x;
+            }
+            for (int i = (int)children[x].size() - 1; i >= 0; i--) stack.push_back(children[x][i]);
+        }
+        online.next[last] = root;
+        online.prev[root] = last;
+        online.root = root;
+        return true;
+    }
+
+    // Insert one-way edge u -> v, relaxing only from v. Each vertex whose
+    // distance drops has its subtree disassembled; finding the relaxing
+    // vertex inside that subtree means the new edge closes a negative cycle
+    // reachable from the capital. Then every change is rolled back, the edge
+    // is rejected and cycle gets its cities (first == last). Work is
+    // proportional to the vertices whose distance changes plus their
+    // subtrees. Other changes to the graph end the online mode; the next
+    // insert restarts it with a full run.
+    bool insertEdgeOnline(char u, char v, int weight, vector<char>& cycle) {
+        cycle.clear();
+        if (online.root == -1 && !startOnline(online.capital)) return false;
+        if (nodeIndex.find(u) == nodeIndex.end()) addVertex(u);
+        if (nodeIndex.find(v) == nodeIndex.end()) addVertex(v);
+        int a = nodeIndex[u], b = nodeIndex[v];
+
+        onlineUndo.clear();
+        online.out[a].push_back(make_pair(b, weight));
+        queue<int> q;
+        vector<int> touched;
+        int tail = -1, head = -1;
+        if (online.dist[a] != INT_MAX && !onlineRelax(a, b, weight, q, touched)) {
+            tail = a;
+            head = b;
+        }
+        while (tail == -1 && !q.empty()) {
+            int x = q.front();
+            q.pop();
+            online.queued[x] = 0;
+            if (online.prev[x] == -1) continue;  // disassembled since it was queued
+            for (int i = 0; i < (int)online.out[x].size() && tail == -1; i++) {
+                int y = online.out[x][i].first;
+                if (!onlineRelax(x, y, online.out[x][i].second, q, touched)) {
+                    tail = x;
+                    head = y;
                 }
             }
         }
+        for (int i = 0; i < (int)touched.size(); i++) online.queued[touched[i]] = 0;
 
-        for (int j = 0; j < (int)edges.size(); j++) {
-            Edge edge = edges[j];
-            int u = nodeIndex.find(edge.from)->second;
-            int v = nodeIndex.find(edge.to)->second;
+        if (tail != -1) {
+            // head -> ... -> tail along the tree, then the closing edge
+            vector<int> path(1, tail);
+            while (path.back() != head) path.push_back(online.parent[path.back()]);
+            for (int i = (int)path.size() - 1; i >= 0; i--) cycle.push_back(indexToNode[path[i]]);
+            cycle.push_back(indexToNode[head]);
 
-            if (dist[u] != INT_MAX && dist[u] + edge.weight < dist[v]) {
-                cout << "Negative cycle detected!" << endl;
-                return make_pair(vector<int>(), vector<int>());
+            for (int i = (int)onlineUndo.size() - 1; i >= 0; i--) {
+                const OnlineChange& c = onlineUndo[i];
+                online.dist[c.vertex] = c.dist;
+                online.parent[c.vertex] = c.parent;
+                online.depth[c.vertex] = c.depth;
+                online.prev[c.vertex] = c.prev;
+                online.next[c.vertex] = c.next;
             }
+            online.out[a].pop_back();
+            return false;
         }
-        return make_pair(dist, parent);
+
+        edgeFrom.push_back(a);
+        edgeTo.push_back(b);
+        edgeWeight.push_back(weight);
+        outOffsets.clear();
+        inOffsets.clear();
+        potentialsReady = false;
+        johnsonForward.clear();
+        johnsonReverse.clear();
+        treeCache.clear();
+        return true;
     }
 
-    // Extract path from parent array
-    vector<char> extractPath(int from, int to, const vector<int>& parent) {
-        vector<char> path;
-        int curr = to;
+    // Distance and path from the online capital (-1 and empty if unreachable)
+    PathResult onlinePath(char end, PathArena<char>& arena) {
+        map<char, int>::const_iterator it = nodeIndex.find(end);
+        if (online.root == -1 || it == nodeIndex.end() || online.dist[it->second] == INT_MAX) {
+            return make_pair(-1, CityPath());
+        }
+        return make_pair(online.dist[it->second],
+                         writePath(online.parent, online.root, online.root, online.parent, it->second, arena));
+    }
 
-        while (curr != from) {
-            path.push_back(indexToNode[curr]);
-            curr = parent[curr];
+    // Replace the graph with a snapshot's CSR. The entries are already
+    // grouped by source vertex, so the edge arrays and the SPFA out-lists
+    // are filled in one pass with no name lookups. City names must be single
+    // characters, as in the text input. The snapshot's cached tree is not
+    // used: it is a Dijkstra tree, and this program is about running
+    // Bellman-Ford. Every offset and target is checked while it is copied,
+    // so a corrupt file is rejected even without --verify-snapshot.
+    bool loadSnapshot(const GraphSnapshot& snapshot) {
+        int n = (int)snapshot.getNumNodes();
+        const uint32_t* offsets = snapshot.getOffsets();
+        nodeIndex.clear();
+        indexToNode.clear();
+        for (int u = 0; u < n; u++) {
+            if (snapshot.nameLength(u) != 1) return false;
+            char name = snapshot.nameData(u)[0];
+            nodeIndex[name] = u;
+            indexToNode.push_back(name);
         }
-        path.push_back(indexToNode[from]);
+        numNodes = n;
+        online.root = -1;
 
-        // Reverse to get path from 'from' to 'to'
-        for (int i = 0; i < (int)path.size() / 2; i++) {
-            char temp = path[i];
-            path[i] = path[path.size() - 1 - i];
-            path[path.size() - 1 - i] = temp;
+        size_t m = (size_t)snapshot.getNumEntries();
+        const uint32_t* targets = snapshot.getTargets();
+        edgeTo.resize(m);
+        edgeWeight.assign(snapshot.getWeights(), snapshot.getWeights() + m);
+        edgeFrom.resize(m);
+        outOffsets.assign(offsets, offsets + n + 1);
+        outEdges.resize(m);
+        for (int u = 0; u < n; u++) {
+            if (offsets[u] > offsets[u + 1]) return false;
+            for (uint32_t e = offsets[u]; e < offsets[u + 1]; e++) {
+                if (targets[e] >= (uint32_t)n) return false;
+                edgeTo[e] = (int)targets[e];
+                edgeFrom[e] = u;
+                outEdges[e] = (int)e;
+            }
         }
+        inOffsets.clear();
+        potentialsReady = false;
+        johnsonForward.clear();
+        johnsonReverse.clear();
+        treeCache.clear();
+        return true;
+    }
+
+    // Replace the graph with unnamed vertices 0..n-1 and the given directed
+    // edges, taking over the vectors. This is for benchmark graphs far
+    // larger than the printable city names allow: afterwards only calls
+    // that work on vertex indices (relax) make sense.
+    void loadEdgeArrays(int n, vector<int>& from, vector<int>& to, vector<int>& weight) {
+        nodeIndex.clear();
+        indexToNode.clear();
+        numNodes = n;
+        online.root = -1;
+        edgeFrom.swap(from);
+        edgeTo.swap(to);
+        edgeWeight.swap(weight);
+        outOffsets.clear();
+        inOffsets.clear();
+        potentialsReady = false;
+        johnsonForward.clear();
+        johnsonReverse.clear();
+        treeCache.clear();
+    }
 
-        return path;
+    int getNumNodes() const { return numNodes; }
+    int getNumEdges() const { return edgeFrom.size(); }
+
+    void setKind(BellmanFordKind newKind) {
+        if (newKind != kind) {
+            kind = newKind;
+            treeCache.clear();
+        }
+    }
+
+    // Thread count for the parallel engine (default: all hardware threads)
+    void setNumThreads(int threads) {
+        numThreads = threads < 1 ? 1 : threads;
+    }
+
+    const RelaxationStats& getLastStats() const { return lastStats; }
+    
+    // Run the selected engine from the distances already set (the start
+    // vertex, or every vertex for Johnson's virtual source). False on a
+    // negative cycle.
+    bool relax(vector<int>& dist, vector<int>& parent) {
+        if (kind == SPFA) return queueRelax(dist, parent);
+        if (kind == PARALLEL_JACOBI) return parallelRelax(dist, parent);
+        return sweepRelax(dist, parent);
+    }
+
+    // Full Bellman-Ford tree from start with the selected engine; empty
+    // vectors if a negative cycle is reachable
+    ShortestPathTree buildTree(char start) {
+        ShortestPathTree tree;
+        tree.dist.assign(numNodes, INT_MAX);
+        tree.parent.assign(numNodes, -1);
+        int startIdx = nodeIndex.find(start)->second;
+        tree.dist[startIdx] = 0;
+
+        lastStats.rounds = 0;
+        lastStats.edgeChecks = 0;
+        lastStats.fullEdgeChecks = (long long)numNodes * edgeFrom.size();
+
+        if (!relax(tree.dist, tree.parent)) {
+            cout << "Negative cycle detected!" << endl;
+            return ShortestPathTree();
+        }
+        tightParents(startIdx, tree.dist, tree.parent, tree.hops);
+        return tree;
+    }
+
+    pair<vector<int>, vector<int> > bellmanFordWithParents(char start) {
+        ShortestPathTree tree = buildTree(start);
+        return make_pair(tree.dist, tree.parent);
+    }
+
+    // Get the shortest-path tree from capital, running Bellman-Ford only the
+    // first time this capital is asked for (or after the graph changed)
+    const ShortestPathTree& getTree(char capital) {
+        map<char, ShortestPathTree>::iterator it = treeCache.find(capital);
+        if (it == treeCache.end()) {
+            ShortestPathTree& tree = treeCache[capital];
+            tree = buildTree(capital);
+            return tree;
+        }
+        return it->second;
+    }
+
+    // Johnson's reweighting: Bellman-Ford from a virtual source joined to
+    // every vertex by a 0-weight edge. Those edges are applied up front by
+    // starting every distance at 0, and the selected engine does the rest,
+    // so the resulting potentials make every reweighted edge non-negative.
+    // Runs once until the graph changes; returns false if the graph has a
+    // negative cycle anywhere, which getNegativeCycle() then lists.
+    bool computePotentials() {
+        if (potentialsReady) return negativeCycle.empty();
+
+        potential.assign(numNodes, 0);
+        vector<int> parent(numNodes, -1);
+        negativeCycle.clear();
+        lastStats.rounds = 0;
+        lastStats.edgeChecks = 0;
+        lastStats.fullEdgeChecks = (long long)numNodes * edgeFrom.size();
+
+        // An engine can stop as soon as it sees the cycle, before the parent
+        // pointers close it; relaxing further always does close it
+        while (!relax(potential, parent)) {
+            negativeCycle = findParentCycle(parent);
+            if (!negativeCycle.empty()) break;
+        }
+
+        potentialsReady = true;
+        return negativeCycle.empty();
+    }
+
+    // Vertices around the negative cycle found by computePotentials
+    vector<char> getNegativeCycle() const {
+        vector<char> cycle;
+        for (int i = 0; i < (int)negativeCycle.size(); i++) {
+            cycle.push_back(indexToNode[negativeCycle[i]]);
+        }
+        return cycle;
+    }
+
+    // Johnson mode query: start -> capital uses the reverse tree and capital
+    // -> end the forward tree, so it stays correct with one-way edges.
+    // Distances can be negative here, so "no path" is an empty path.
+    PathResult johnsonPathViaCapital(char start, char end, char capital, PathArena<char>& arena) {
+        if (!computePotentials()) {
+            return make_pair(-1, CityPath());
+        }
+
+        int capitalIdx = nodeIndex.find(capital)->second;
+        int startIdx = nodeIndex.find(start)->second;
+        int endIdx = nodeIndex.find(end)->second;
+
+        if (johnsonForward.find(capital) == johnsonForward.end()) {
+            johnsonForward[capital] = johnsonDijkstra(capitalIdx, false);
+            johnsonReverse[capital] = johnsonDijkstra(capitalIdx, true);
+        }
+        const ShortestPathTree& forward = johnsonForward[capital];
+        const ShortestPathTree& reverse = johnsonReverse[capital];
+
+        if (reverse.dist[startIdx] == INT_MAX || forward.dist[endIdx] == INT_MAX) {
+            return make_pair(-1, CityPath());
+        }
+
+        // start -> ... -> capital by next hops, then capital -> ... -> end
+        return make_pair(reverse.dist[startIdx] + forward.dist[endIdx],
+                         writePath(reverse.parent, startIdx, capitalIdx, forward.parent, endIdx, arena));
+    }
+
+    // All-pairs distances with one Dijkstra per source on the reweighted
+    // graph (INT_MAX where unreachable). Empty if there is a negative cycle.
+    vector<vector<int> > johnsonAllPairs() {
+        vector<vector<int> > dist;
+        if (!computePotentials()) return dist;
+        for (int s = 0; s < numNodes; s++) {
+            dist.push_back(johnsonDijkstra(s, false).dist);
+        }
+        return dist;
+    }
+
+    char getNodeName(int idx) const { return indexToNode[idx]; }
+
+    // Path start -> ... -> capital -> ... -> end written straight into the
+    // arena. Climbing up from start gives the first half in order, and
+    // climbing down's parents from end fills the second half from the
+    // back, so nothing is reversed or spliced. Both walks are done twice,
+    // once to size the path and once to write it.
+    CityPath writePath(const vector<int>& up, int start, int capital, const vector<int>& down, int end,
+                       PathArena<char>& arena) const {
+        size_t length = 1;
+        for (int curr = start; curr != capital; curr = up[curr]) length++;
+        for (int curr = end; curr != capital; curr = down[curr]) length++;
+        char* out = arena.allocate(length);
+        size_t front = 0, back = length;
+        for (int curr = start; curr != capital; curr = up[curr]) out[front++] = indexToNode[curr];
+        for (int curr = end; curr != capital; curr = down[curr]) out[--back] = indexToNode[curr];
+        out[front] = indexToNode[capital];
+        return CityPath(out, length);
     }
     
     void printGraph() {
-        cout << "Graph with " << numNodes << " nodes and " << edges.size() << " directed edges:" << endl;
-        for (int i = 0; i < (int)edges.size(); i++) {
-            cout << "Edge " << i << ": " << edges[i].from << " -> " << edges[i].to 
-                 << " (weight: " << edges[i].weight << ")" << endl;
+        cout << "Graph with " << numNodes << " nodes and " << edgeFrom.size() << " directed edges:" << endl;
+        for (int i = 0; i < (int)edgeFrom.size(); i++) {
+            cout << "Edge " << i << ": " << indexToNode[edgeFrom[i]] << " -> " << indexToNode[edgeTo[i]]
+                 << " (weight: " << edgeWeight[i] << ")" << endl;
         }
     }
     
     map<char, int> getNodeIndex() const { return nodeIndex; }
     
-    pair<int, vector<char> > shortestPathViaCapital(char start, char end, char capital) {
-        pair<vector<int>, vector<int> > result = bellmanFordWithParents(capital);
-        vector<int> distFromCapital = result.first;
-        vector<int> parent = result.second;
+    // The path lives in arena until it is cleared
+    PathResult shortestPathViaCapital(char start, char end, char capital, PathArena<char>& arena) {
+        const ShortestPathTree& tree = getTree(capital);
+        const vector<int>& distFromCapital = tree.dist;
+        const vector<int>& parent = tree.parent;
 
         if (distFromCapital.empty()) {
             cout << "Cannot compute paths due to negative cycle!" << endl;
-            return make_pair(-1, vector<char>());
+            return make_pair(-1, CityPath());
         }
 
         int capitalIdx = nodeIndex.find(capital)->second;
@@ -127,71 +1202,358 @@ public:
         int endIdx = nodeIndex.find(end)->second;
 
         if (distFromCapital[startIdx] == INT_MAX || distFromCapital[endIdx] == INT_MAX) {
-            vector<char> emptyPath;
-            return make_pair(-1, emptyPath);
+            return make_pair(-1, CityPath());
         }
 
         int totalDist = distFromCapital[startIdx] + distFromCapital[endIdx];
-
-        // Build actual path: start -> ... -> capital -> ... -> end
-        vector<char> pathToStart = extractPath(capitalIdx, startIdx, parent);
-        vector<char> pathToEnd = extractPath(capitalIdx, endIdx, parent);
-
-        vector<char> fullPath;
-        // Reverse path from capital to start (to get start to capital)
-        for (int i = (int)pathToStart.size() - 1; i >= 0; i--) {
-            fullPath.push_back(pathToStart[i]);
-        }
-        // Add path from capital to end (skip capital since already added)
-        for (int i = 1; i < (int)pathToEnd.size(); i++) {
-            fullPath.push_back(pathToEnd[i]);
-        }
-
-        return make_pair(totalDist, fullPath);
+        return make_pair(totalDist, writePath(parent, startIdx, capitalIdx, parent, endIdx, arena));
     }
     
-    void printPath(const vector<char>& path) {
+    void printPath(const CityPath& path) {
         for (int i = 0; i < (int)path.size(); i++) {
             cout << path[i];
             if (i < (int)path.size() - 1) cout << ", ";
         }
     }
+
+    void printPath(const vector<char>& path) {
+        printPath(CityPath(path.data(), path.size()));
+    }
 };
 
-int main() {
+// Parallel Jacobi rounds against the sweep engine on a large random road
+// graph built straight into the edge arrays (the printable city names cap
+// text graphs at about 90 cities, where only thread start-up is measured).
+// Each road is two directed edges whose weights are a 500-1000 length
+// shifted by random vertex potentials, w + p[u] - p[v]: many edges are
+// negative, but every cycle keeps its positive length, so none is negative.
+// Only the relaxation itself is timed, and the time is also given per
+// round, which is what the thread count should divide.
+void runParallelBenchmark() {
+    const int n = 1000000, numRoads = 2000000, runs = 3;
+    mt19937 rng(2301);
+    vector<int> p(n);
+    for (int v = 0; v < n; v++) p[v] = rng() % 2000;
+    vector<int> from, to, weight;
+    from.reserve(2 * numRoads);
+    to.reserve(2 * numRoads);
+    weight.reserve(2 * numRoads);
+    for (int i = 0; i < numRoads; i++) {
+        int a = rng() % n, b = rng() % n;
+        int length = 500 + rng() % 501;
+        from.push_back(a);
+        to.push_back(b);
+        weight.push_back(length + p[a] - p[b]);
+        from.push_back(b);
+        to.push_back(a);
+        weight.push_back(length + p[b] - p[a]);
+    }
     BellmanFordGraph g;
+    g.loadEdgeArrays(n, from, to, weight);
+
+    cout << "=== PARALLEL BELLMAN-FORD BENCHMARK (" << n << " vertices, " << g.getNumEdges() << " directed edges, "
+         << runs << " runs, kernel: " << relaxKernelName() << ") ===" << endl;
+
+    // Average time and rounds of runs full relaxations from vertex 0
+    vector<int> dist, parent;
+    auto timeRelax = [&](long long& us, int& rounds) {
+        us = 0;
+        for (int r = 0; r < runs; r++) {
+            dist.assign(n, INT_MAX);
+            parent.assign(n, -1);
+            dist[0] = 0;
+            int before = g.getLastStats().rounds;
+            auto start = high_resolution_clock::now();
+            g.relax(dist, parent);
+            us += duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+            rounds = g.getLastStats().rounds - before;
+        }
+        us /= runs;
+    };
+
+    long long us;
+    int rounds;
+    g.setKind(SWEEP);
+    timeRelax(us, rounds);
+    vector<int> reference = dist;
+    cout << "Sweep engine: " << us / 1000 << " ms per run, " << rounds << " rounds, "
+         << us / max(rounds, 1) << " us per round" << endl;
+
+    cout << "Threads\tTime(ms)\tRounds\tPer round(us)\tSame distances\tSame parents as 1 thread" << endl;
+    g.setKind(PARALLEL_JACOBI);
+    vector<int> firstParents;
+    int maxThreads = max(1, (int)thread::hardware_concurrency());
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        g.setNumThreads(threads);
+        timeRelax(us, rounds);
+        if (firstParents.empty()) firstParents = parent;
+        cout << threads << "\t" << us / 1000 << "\t" << rounds << "\t" << us / max(rounds, 1) << "\t"
+             << (dist == reference ? "yes" : "NO") << "\t"
+             << (parent == firstParents ? "yes" : "NO") << endl;
+    }
+    cout << endl;
+}
+
+// Edge updates on a random graph with every printable city name: two-way
+// roads (500-1000) plus one-way edges that may be negative, which only run
+// towards later cities so no negative cycle can form. Compares repairing
+// the capital's tree with rerunning Bellman-Ford, and checks they agree.
+void runUpdateBenchmark() {
+    const int n = 90, numRoads = 400, numOneWay = 400, numUpdates = 300;
+    mt19937 rng(2201);
+    BellmanFordGraph g;
+    vector<pair<char, char> > roads, oneWay;
+    for (int i = 0; i < n; i++) {
+        roads.push_back(make_pair((char)('!' + i), (char)('!' + (i + 1) % n)));
+    }
+    while ((int)roads.size() < numRoads) {
+        roads.push_back(make_pair((char)('!' + rng() % n), (char)('!' + rng() % n)));
+    }
+    for (int i = 0; i < (int)roads.size(); i++) g.addEdge(roads[i].first, roads[i].second, 500 + rng() % 501);
+    for (int i = 0; i < numOneWay; i++) {
+        int a = rng() % (n - 1);
+        int b = a + 1 + rng() % (n - 1 - a);
+        oneWay.push_back(make_pair((char)('!' + a), (char)('!' + b)));
+        g.addDirectedEdge(oneWay.back().first, oneWay.back().second, (int)(rng() % 106) - 5);
+    }
+    char capital = '!';
+    g.getTree(capital);
+
+    cout << "=== EDGE UPDATE BENCHMARK (" << n << " cities, " << g.getNumEdges() << " directed edges, "
+         << numUpdates << " updates) ===" << endl;
+    long long repairTime = 0, recomputeTime = 0;
+    int mismatches = 0;
+    for (int k = 0; k < numUpdates; k++) {
+        auto start = high_resolution_clock::now();
+        if (k % 3 == 0) {
+            pair<char, char> r = roads[rng() % roads.size()];
+            g.updateEdgeWeight(r.first, r.second, 500 + rng() % 501);
+        } else if (k % 3 == 1) {
+            pair<char, char> e = oneWay[rng() % oneWay.size()];
+            g.updateDirectedEdgeWeight(e.first, e.second, (int)(rng() % 106) - 5);
+        } else {
+            pair<char, char> e = oneWay[rng() % oneWay.size()];
+            g.removeDirectedEdge(e.first, e.second);
+        }
+        const ShortestPathTree& repaired = g.getTree(capital);
+        repairTime += duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+        start = high_resolution_clock::now();
+        pair<vector<int>, vector<int> > full = g.bellmanFordWithParents(capital);
+        recomputeTime += duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+        if (full.first != repaired.dist || full.second != repaired.parent) mismatches++;
+    }
+    cout << "Update with repair:\t" << repairTime / numUpdates << " us average" << endl;
+    cout << "Full Bellman-Ford:\t" << recomputeTime / numUpdates << " us average" << endl;
+    cout << "Repaired trees differing from a recompute: " << mismatches << endl;
+    cout << endl;
+}
+
+// Online mode on stdin: "u v weight" inserts a one-way edge, rejected with
+// the cycle it would close if that makes a negative cycle reachable from
+// the capital; "dist v" prints v's distance and path from the capital
+void runOnlineMode(BellmanFordGraph& g, char capital) {
+    if (!g.startOnline(capital)) {
+        cout << "Error: the graph already has a negative cycle" << endl;
+        return;
+    }
+    string first, second;
+    int weight;
+    long long inserted = 0, rejected = 0;
+    vector<char> cycle;
+    PathArena<char> paths;
+    while (cin >> first) {
+        if (first == "dist") {
+            if (!(cin >> second)) break;
+            paths.clear();
+            PathResult result = g.onlinePath(second[0], paths);
+            cout << second[0] << " " << result.first;
+            if (!result.second.empty()) {
+                cout << " ";
+                g.printPath(result.second);
+            }
+            cout << endl;
+        } else if (cin >> second >> weight) {
+            if (g.insertEdgeOnline(first[0], second[0], weight, cycle)) {
+                inserted++;
+            } else {
+                rejected++;
+                cout << "Rejected " << first[0] << " -> " << second[0] << " (" << weight << "): negative cycle ";
+                g.printPath(cycle);
+                cout << endl;
+            }
+        } else {
+            cout << "Error: expected \"u v weight\" or \"dist v\"" << endl;
+            break;
+        }
+    }
+    cout << "Stream closed: " << inserted << " edges inserted, " << rejected << " rejected" << endl;
+}
+
+// Classic Bellman-Ford over a plain edge list, the reference for the
+// online benchmark (empty if a negative cycle is reachable)
+vector<int> referenceBellmanFord(int n, const vector<int>& from, const vector<int>& to, const vector<int>& weight,
+                                 int source) {
+    vector<int> dist(n, INT_MAX);
+    dist[source] = 0;
+    for (int round = 0; round <= n; round++) {
+        bool changed = false;
+        for (int j = 0; j < (int)from.size(); j++) {
+            if (dist[from[j]] != INT_MAX && dist[from[j]] + weight[j] < dist[to[j]]) {
+                dist[to[j]] = dist[from[j]] + weight[j];
+                changed = true;
+            }
+        }
+        if (!changed) return dist;
+    }
+    return vector<int>();
+}
+
+// Streams random one-way inserts, many of them negative enough to close a
+// cycle with the two-way roads, into the online mode. Every decision and
+// distance is checked against a full Bellman-Ford over the accepted edges.
+void runOnlineBenchmark() {
+    const int n = 90, numRoads = 400, numInserts = 3000;
+    mt19937 rng(2300);
+    BellmanFordGraph g;
+    vector<int> from, to, weight;
+    for (int i = 0; i < numRoads; i++) {
+        int a = i < n ? i : rng() % n, b = i < n ? (i + 1) % n : rng() % n;
+        int w = 500 + rng() % 501;
+        g.addEdge((char)('!' + a), (char)('!' + b), w);
+        from.push_back(a), to.push_back(b), weight.push_back(w);
+        from.push_back(b), to.push_back(a), weight.push_back(w);
+    }
+    g.startOnline('!');
+
+    cout << "=== ONLINE NEGATIVE CYCLE BENCHMARK (" << n << " cities, " << numRoads << " roads, " << numInserts
+         << " one-way inserts) ===" << endl;
+    long long onlineTime = 0, fullTime = 0;
+    int rejected = 0, disagreements = 0;
+    vector<char> cycle;
+    PathArena<char> paths;
+    for (int k = 0; k < numInserts; k++) {
+        int a = rng() % n, b = rng() % n, w = (int)(rng() % 2001) - 1200;
+        auto start = high_resolution_clock::now();
+        bool accepted = g.insertEdgeOnline((char)('!' + a), (char)('!' + b), w, cycle);
+        onlineTime += duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+        from.push_back(a), to.push_back(b), weight.push_back(w);
+        start = high_resolution_clock::now();
+        vector<int> full = referenceBellmanFord(n, from, to, weight, 0);
+        fullTime += duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+        if (!accepted) {
+            rejected++;
+            from.pop_back(), to.pop_back(), weight.pop_back();
+        }
+        bool agree = accepted ? !full.empty() : full.empty();
+        for (int v = 0; agree && accepted && v < n; v++) {
+            paths.clear();
+            agree = g.onlinePath((char)('!' + v), paths).first == full[v];
+        }
+        if (!agree) disagreements++;
+    }
+    cout << "Online insert:\t\t" << onlineTime / numInserts << " us average" << endl;
+    cout << "Full Bellman-Ford:\t" << fullTime / numInserts << " us average" << endl;
+    cout << "Rejected: " << rejected << ", disagreements with the full run: " << disagreements << endl;
+    cout << endl;
+}
+
+int main(int argc, char* argv[]) {
+    BellmanFordKind kind = SWEEP;
+    int threads = 0;
+    bool johnson = false;
+    bool online = false;
+    bool directed = false;
+    string snapshotFile;
+    bool verifySnapshot = false;
+    string queriesFile = "B2_input.txt";
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--bf=sweep") {
+            kind = SWEEP;
+        } else if (arg == "--bf=spfa") {
+            kind = SPFA;
+        } else if (arg == "--bf=parallel") {
+            kind = PARALLEL_JACOBI;
+        } else if (arg == "--johnson") {
+            johnson = true;
+        } else if (arg == "--directed") {
+            directed = true;
+        } else if (arg.compare(0, 10, "--threads=") == 0) {
+            threads = atoi(arg.c_str() + 10);
+        } else if (arg.compare(0, 11, "--snapshot=") == 0) {
+            snapshotFile = arg.substr(11);
+        } else if (arg == "--verify-snapshot") {
+            verifySnapshot = true;
+        } else if (arg.compare(0, 10, "--queries=") == 0) {
+            queriesFile = arg.substr(10);
+        } else if (arg == "--bench-parallel") {
+            runParallelBenchmark();
+            return 0;
+        } else if (arg == "--bench-update") {
+            runUpdateBenchmark();
+            return 0;
+        } else if (arg == "--online") {
+            online = true;
+        } else if (arg == "--bench-online") {
+            runOnlineBenchmark();
+            return 0;
+        } else {
+            cout << "Usage: " << argv[0] << " [--bf=sweep|spfa|parallel] [--threads=N] [--johnson] [--directed]"
+                 << " [--snapshot=FILE [--verify-snapshot]] [--queries=FILE] [--online]"
+                 << " [--bench-parallel] [--bench-update] [--bench-online]" << endl;
+            return 1;
+        }
+    }
+
+    BellmanFordGraph g;
+    g.setKind(kind);
+    if (threads > 0) g.setNumThreads(threads);
     
-    ifstream inputFile("B2_input.txt");
-    if (!inputFile.is_open()) {
-        cout << "Error: Could not open B2_input.txt" << endl;
+    // With a snapshot (written by B2_shortest_paths --write-snapshot) the
+    // graph comes from the mapped file and only query lines are read
+    if (!snapshotFile.empty()) {
+        GraphSnapshot snapshot;
+        if (!snapshot.load(snapshotFile, verifySnapshot)) {
+            cout << "Error: " << snapshot.getError() << endl;
+            return 1;
+        }
+        if (!g.loadSnapshot(snapshot)) {
+            cout << "Error: " << snapshotFile << " has city names longer than one character or edges outside the graph"
+                 << endl;
+            return 1;
+        }
+    }
+
+    EdgeListFile inputFile;
+    if (!inputFile.load(queriesFile)) {
+        cout << "Error: Could not open " << queriesFile << endl;
         return 1;
     }
-    
-    string line;
-    vector<pair<char, char> > queries;
-    
-    while (getline(inputFile, line)) {
-        if (line.empty()) continue;
-        
-        stringstream ss(line);
-        string token1, token2, token3;
-        
-        if (ss >> token1 >> token2 >> token3) {
-            char u = token1[0];
-            char v = token2[0];
-            int weight = stoi(token3);
-            g.addEdge(u, v, weight);
-        } else if (ss.str().find(' ') != string::npos) {
-            stringstream ss2(line);
-            char start, end;
-            if (ss2 >> start >> end) {
-                queries.push_back(make_pair(start, end));
+
+    if (snapshotFile.empty()) {
+        const vector<EdgeRecord>& records = inputFile.getEdges();
+        // --directed reads every edge line as one way, so weights may be negative
+        for (int i = 0; i < (int)records.size(); i++) {
+            if (directed) {
+                g.addDirectedEdge(records[i].from.data[0], records[i].to.data[0], records[i].weight);
+            } else {
+                g.addEdge(records[i].from.data[0], records[i].to.data[0], records[i].weight);
             }
         }
     }
-    inputFile.close();
+    vector<pair<char, char> > queries;
+    for (int i = 0; i < (int)inputFile.getQueries().size(); i++) {
+        const QueryRecord& q = inputFile.getQueries()[i];
+        queries.push_back(make_pair(q.from.data[0], q.to.data[0]));
+    }
     
     char capital = 'a';
+    if (online) {
+        runOnlineMode(g, capital);
+        return 0;
+    }
 
     cout << "=== BELLMAN-FORD ALGORITHM ===" << endl;
     cout << "Graph has " << g.getNumNodes() << " nodes and " << g.getNumEdges() << " directed edges" << endl;
@@ -204,15 +1566,47 @@ int main() {
 
     ofstream outputFile("B3_output.txt");
 
-    cout << "Running Bellman-Ford from capital '" << capital << "'..." << endl;
-    cout << "Will relax edges " << (g.getNumNodes() - 1) << " times" << endl << endl;
+    if (johnson) {
+        cout << "Johnson mode: one Bellman-Ford for vertex potentials, then Dijkstra per capital" << endl;
+    } else {
+        cout << "Running Bellman-Ford from capital '" << capital << "'..." << endl;
+    }
+    if (kind == SPFA) {
+        cout << "Using SPFA (queue of vertices whose distance changed)" << endl << endl;
+    } else if (kind == PARALLEL_JACOBI) {
+        cout << "Using parallel Jacobi rounds (stopping once a round changes nothing)" << endl << endl;
+    } else {
+        cout << "Will relax edges up to " << (g.getNumNodes() - 1) << " times (stopping once a round changes nothing)" << endl << endl;
+    }
 
+    // Timed from here, so Johnson's potentials run counts like the
+    // Bellman-Ford behind the first query does in the other modes
     auto start = high_resolution_clock::now();
 
-    vector<pair<int, vector<char> > > results;
+    if (johnson && !g.computePotentials()) {
+        vector<char> cycle = g.getNegativeCycle();
+        cout << "Negative cycle detected: ";
+        g.printPath(cycle);
+        cout << endl;
+        if (outputFile.is_open()) {
+            outputFile << "Negative cycle detected: ";
+            for (int j = 0; j < (int)cycle.size(); j++) {
+                outputFile << cycle[j];
+                if (j < (int)cycle.size() - 1) outputFile << ", ";
+            }
+            outputFile << endl;
+            outputFile.close();
+        }
+        return 0;
+    }
+
+    vector<PathResult> results;
+    PathArena<char> paths;
     for (int i = 0; i < (int)queries.size(); i++) {
         cout << "Computing path: " << queries[i].first << " -> " << capital << " -> " << queries[i].second << endl;
-        pair<int, vector<char> > result = g.shortestPathViaCapital(queries[i].first, queries[i].second, capital);
+        PathResult result = johnson
+            ? g.johnsonPathViaCapital(queries[i].first, queries[i].second, capital, paths)
+            : g.shortestPathViaCapital(queries[i].first, queries[i].second, capital, paths);
         results.push_back(result);
     }
 
@@ -227,7 +1621,7 @@ int main() {
              << "); **//" << endl;
         cout << endl;
 
-        if (results[i].first == -1) {
+        if (results[i].second.empty()) {
             cout << "No path exists (disconnected components)" << endl;
             cout << endl;
         } else {
@@ -245,7 +1639,7 @@ int main() {
                        << "); **//" << endl;
             outputFile << endl;
 
-            if (results[i].first == -1) {
+            if (results[i].second.empty()) {
                 outputFile << "No path exists (disconnected components)" << endl;
                 outputFile << endl;
             } else {
@@ -261,10 +1655,58 @@ int main() {
         }
     }
 
+    // Report how much relaxation work the early exit / queue saved
+    const RelaxationStats& stats = g.getLastStats();
+    long long saved = stats.fullEdgeChecks - stats.edgeChecks;
+    int savedPercent = stats.fullEdgeChecks > 0 ? (int)(100 * saved / stats.fullEdgeChecks) : 0;
+    // SPFA counts queue pops, which have no fixed bound. A sweep needs at
+    // most V-1 rounds; Jacobi rounds only see the previous round's
+    // distances, so they need one more to notice nothing changed.
+    string passName = kind == SPFA ? "Queue pops" : "Relaxation rounds";
+    string fullRounds;
+    if (kind == SWEEP) {
+        fullRounds = " (full Bellman-Ford: " + to_string(g.getNumNodes() - 1) + " rounds)";
+    } else if (kind == PARALLEL_JACOBI) {
+        fullRounds = " (full Jacobi run: " + to_string(g.getNumNodes()) + " rounds)";
+    }
+
+    cout << "//** print out relaxation work **//" << endl;
+    cout << passName << ": " << stats.rounds << fullRounds << endl;
+    cout << "Edge checks: " << stats.edgeChecks << " of " << stats.fullEdgeChecks
+         << " (saved " << savedPercent << "%)" << endl;
+    cout << endl;
+
+    if (outputFile.is_open()) {
+        outputFile << "//** print out relaxation work **//" << endl;
+        outputFile << passName << ": " << stats.rounds << fullRounds << endl;
+        outputFile << "Edge checks: " << stats.edgeChecks << " of " << stats.fullEdgeChecks
+                   << " (saved " << savedPercent << "%)" << endl;
+        outputFile << endl;
+    }
+
     cout << "//** print out running time **//" << endl;
     cout << "Running-time: " << duration.count() << " microseconds" << endl;
     cout << endl;
 
+    if (johnson && g.getNumNodes() <= 26) {
+        // Small graphs: show the all-pairs table from the same potentials
+        vector<vector<int> > allPairs = g.johnsonAllPairs();
+        cout << "All-pairs distances (Johnson):" << endl;
+        cout << "  ";
+        for (int v = 0; v < g.getNumNodes(); v++) cout << "\t" << g.getNodeName(v);
+        cout << endl;
+        for (int u = 0; u < g.getNumNodes(); u++) {
+            cout << "  " << g.getNodeName(u);
+            for (int v = 0; v < g.getNumNodes(); v++) {
+                cout << "\t";
+                if (allPairs[u][v] == INT_MAX) cout << "-";
+                else cout << allPairs[u][v];
+            }
+            cout << endl;
+        }
+        cout << endl;
+    }
+
     if (outputFile.is_open()) {
         outputFile << "//** print out running time **//" << endl;
         outputFile << "Running-time: " << duration.count() << " microseconds" << endl;
@@ -0,0 +1,212 @@
+#ifndef EDGE_LOADER_H
+#define EDGE_LOADER_H
+
+// Input loader shared by B1, B2 and B3. It keeps the assignment's line formats:
+//   "u v weight"   edge line (three or more tokens, integer weight)
+//   "u v"          query line (exactly two tokens)
+// Anything else (blank lines, single tokens) is skipped.
+//
+// The file is memory-mapped and split into one chunk per thread on newline
+// boundaries. Each chunk is scanned in parallel with a hand-rolled
+// tokenizer and integer parser. Tokens are views into the mapping, so no
+// line allocates; the views stay valid as long as the EdgeListFile lives.
+// Records come out in file order.
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <cstdint>
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct TokenView {
+    const char* data;
+    uint32_t length;
+
+    std::string str() const {
+        return std::string(data, length);
+    }
+
+    // Integer that follows a one-character prefix, e.g. 12 for "p12"
+    // (-1 if there are no digits or the number is above INT_MAX)
+    int suffixNumber() const {
+        long long value = 0;
+        bool digits = false;
+        for (uint32_t i = 1; i < length && data[i] >= '0' && data[i] <= '9'; i++) {
+            value = value * 10 + (data[i] - '0');
+            if (value > INT_MAX) return -1;
+            digits = true;
+        }
+        return digits ? (int)value : -1;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const TokenView& t) {
+    return out.write(t.data, t.length);
+}
+
+struct EdgeRecord {
+    TokenView from;
+    TokenView to;
+    int weight;
+};
+
+struct QueryRecord {
+    TokenView from;
+    TokenView to;
+};
+
+class EdgeListFile {
+private:
+    const char* data;
+    size_t size;
+    std::vector<EdgeRecord> edges;
+    std::vector<QueryRecord> queries;
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    // Leading integer of a token like stoi would read it; false if the
+    // token does not start with one
+    static bool parseInt(const TokenView& t, int& out) {
+        uint32_t i = 0;
+        bool negative = false;
+        if (i < t.length && (t.data[i] == '-' || t.data[i] == '+')) negative = t.data[i++] == '-';
+        if (i >= t.length || t.data[i] < '0' || t.data[i] > '9') return false;
+        long long value = 0;
+        for (; i < t.length && t.data[i] >= '0' && t.data[i] <= '9'; i++) {
+            value = value * 10 + (t.data[i] - '0');
+            if (value > INT_MAX) return false;
+        }
+        out = (int)(negative ? -value : value);
+        return true;
+    }
+
+    static void scanChunk(const char* p, const char* end, std::vector<EdgeRecord>& chunkEdges,
+                          std::vector<QueryRecord>& chunkQueries) {
+        TokenView tokens[3];
+        while (p < end) {
+            int count = 0;
+            while (p < end && *p != '\n') {
+                while (p < end && isSpace(*p)) p++;
+                if (p >= end || *p == '\n') break;
+                const char* start = p;
+                while (p < end && *p != '\n' && !isSpace(*p)) p++;
+                if (count < 3) {
+                    tokens[count].data = start;
+                    tokens[count].length = (uint32_t)(p - start);
+                }
+                count++;
+            }
+            if (p < end) p++;  // past the newline
+
+            EdgeRecord edge;
+            if (count >= 3 && parseInt(tokens[2], edge.weight)) {
+                edge.from = tokens[0];
+                edge.to = tokens[1];
+                chunkEdges.push_back(edge);
+            } else if (count == 2) {
+                QueryRecord query;
+                query.from = tokens[0];
+                query.to = tokens[1];
+                chunkQueries.push_back(query);
+            }
+        }
+    }
+
+    void unmap() {
+        if (data != NULL) munmap((void*)data, size);
+        data = NULL;
+        size = 0;
+    }
+
+    EdgeListFile(const EdgeListFile&);
+    EdgeListFile& operator=(const EdgeListFile&);
+
+public:
+    EdgeListFile() : data(NULL), size(0) {}
+
+    ~EdgeListFile() {
+        unmap();
+    }
+
+    // threads <= 0 picks one thread per MB of input, up to the core count
+    bool load(const std::string& fileName, int threads = 0) {
+        unmap();
+        edges.clear();
+        queries.clear();
+        int fd = open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            return false;
+        }
+        size = (size_t)info.st_size;
+        if (size > 0) {
+            void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                close(fd);
+                size = 0;
+                return false;
+            }
+            data = (const char*)mapped;
+            madvise(mapped, size, MADV_SEQUENTIAL);
+        }
+        close(fd);
+        if (size == 0) return true;
+
+        if (threads <= 0) {
+            threads = (int)std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), size / (1 << 20) + 1);
+        }
+        // Chunk t starts just after the first newline at or past t * size / threads
+        std::vector<const char*> bounds(threads + 1);
+        bounds[0] = data;
+        bounds[threads] = data + size;
+        for (int t = 1; t < threads; t++) {
+            const char* p = std::max(bounds[t - 1], data + size * t / threads);
+            while (p < data + size && p > data && *(p - 1) != '\n') p++;
+            bounds[t] = p;
+        }
+
+        std::vector<std::vector<EdgeRecord> > chunkEdges(threads);
+        std::vector<std::vector<QueryRecord> > chunkQueries(threads);
+        std::vector<std::thread> pool;
+        for (int t = 1; t < threads; t++) {
+            pool.push_back(std::thread(scanChunk, bounds[t], bounds[t + 1], std::ref(chunkEdges[t]),
+                                       std::ref(chunkQueries[t])));
+        }
+        scanChunk(bounds[0], bounds[1], chunkEdges[0], chunkQueries[0]);
+        for (int t = 0; t < (int)pool.size(); t++) pool[t].join();
+
+        size_t totalEdges = 0, totalQueries = 0;
+        for (int t = 0; t < threads; t++) {
+            totalEdges += chunkEdges[t].size();
+            totalQueries += chunkQueries[t].size();
+        }
+        edges.reserve(totalEdges);
+        queries.reserve(totalQueries);
+        for (int t = 0; t < threads; t++) {
+            edges.insert(edges.end(), chunkEdges[t].begin(), chunkEdges[t].end());
+            queries.insert(queries.end(), chunkQueries[t].begin(), chunkQueries[t].end());
+        }
+        return true;
+    }
+
+    const std::vector<EdgeRecord>& getEdges() const {
+        return edges;
+    }
+
+    const std::vector<QueryRecord>& getQueries() const {
+        return queries;
+    }
+};
+
+#endif
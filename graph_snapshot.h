@@ -0,0 +1,291 @@
+#ifndef GRAPH_SNAPSHOT_H
+#define GRAPH_SNAPSHOT_H
+
+// Binary graph snapshot shared by B2 and B3, so big graphs start without
+// re-parsing text. The file is a fixed header followed by 8-byte aligned
+// sections, all in native byte order:
+//   offsets     uint32[numNodes + 1]   CSR: neighbours of u are entries
+//   targets     uint32[numEntries]       offsets[u] .. offsets[u+1]-1
+//   weights     int32[numEntries]
+//   nameOffsets uint64[numNodes + 1]   name of u is nameBytes[nameOffsets[u] ..
+//   nameBytes   char[nameBytesSize]      nameOffsets[u+1])
+//   nameTable   uint32[tableSize]      open addressing, FNV-1a of the name,
+//                                      linear probing, NO_VERTEX = empty
+//   treeDist    int32[numNodes]        optional (SNAPSHOT_HAS_TREE): shortest-
+//   treeParent  int32[numNodes]          path tree from vertex treeSource
+// Each undirected edge appears as two CSR entries. The header carries a
+// version and an FNV-1a 64 checksum per section (the two tree arrays count
+// as one). Loading maps the file read-only and hands out pointers into the
+// mapping; nothing is copied or rebuilt. The header and section bounds are
+// always checked, but the checksums only on request, since hashing every
+// byte would read the whole file before the first query.
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const uint32_t SNAPSHOT_VERSION = 2;
+const uint32_t SNAPSHOT_HAS_TREE = 1;
+const uint32_t SNAPSHOT_NO_VERTEX = UINT32_MAX;
+const int SNAPSHOT_SECTIONS = 7;
+
+struct SnapshotHeader {
+    char magic[8];  // "GRAPHSNP"
+    uint32_t version;
+    uint32_t flags;
+    uint64_t numNodes;
+    uint64_t numEntries;  // directed CSR entries
+    uint64_t nameBytesSize;
+    uint64_t tableSize;   // power of two
+    int32_t maxWeight;
+    uint32_t treeSource;
+    uint64_t checksums[SNAPSHOT_SECTIONS];  // in file order, padding included
+};
+
+inline uint32_t snapshotNameHash(const char* s, size_t length) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+inline uint64_t snapshotChecksum(const char* data, size_t length) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        h = (h ^ (unsigned char)data[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+inline size_t snapshotAlign(size_t bytes) {
+    return (bytes + 7) & ~(size_t)7;
+}
+
+// Padded byte size of each section the header describes (0 for a missing
+// tree). The counts must already be known to fit the file, so the
+// products cannot overflow.
+inline void snapshotSectionSizes(const SnapshotHeader& header, uint64_t sizes[SNAPSHOT_SECTIONS]) {
+    uint64_t n = header.numNodes, m = header.numEntries;
+    sizes[0] = snapshotAlign((n + 1) * sizeof(uint32_t));
+    sizes[1] = snapshotAlign(m * sizeof(uint32_t));
+    sizes[2] = snapshotAlign(m * sizeof(int32_t));
+    sizes[3] = snapshotAlign((n + 1) * sizeof(uint64_t));
+    sizes[4] = snapshotAlign(header.nameBytesSize);
+    sizes[5] = snapshotAlign(header.tableSize * sizeof(uint32_t));
+    sizes[6] = (header.flags & SNAPSHOT_HAS_TREE) ? 2 * snapshotAlign(n * sizeof(int32_t)) : 0;
+}
+
+// Appends one section and pads it to 8 bytes
+inline void snapshotAppend(std::vector<char>& out, const void* data, size_t length) {
+    out.insert(out.end(), (const char*)data, (const char*)data + length);
+    out.resize(snapshotAlign(out.size()), 0);
+}
+
+// Writes a snapshot; dist/parent may be NULL for no cached tree
+inline bool writeGraphSnapshot(const std::string& fileName, const std::vector<std::string>& names,
+                               const uint32_t* offsets, const uint32_t* targets, const int* weights,
+                               int maxWeight, uint32_t treeSource, const int* dist, const int* parent) {
+    uint64_t n = names.size();
+    uint64_t m = offsets[n];
+    std::vector<uint64_t> nameOffsets(n + 1, 0);
+    for (uint64_t i = 0; i < n; i++) nameOffsets[i + 1] = nameOffsets[i] + names[i].size();
+    uint64_t tableSize = 1;
+    while (tableSize < 2 * n) tableSize <<= 1;
+    std::vector<uint32_t> table(tableSize, SNAPSHOT_NO_VERTEX);
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t slot = snapshotNameHash(names[i].data(), names[i].size()) & (tableSize - 1);
+        while (table[slot] != SNAPSHOT_NO_VERTEX) slot = (slot + 1) & (tableSize - 1);
+        table[slot] = (uint32_t)i;
+    }
+
+    // Lay every section out in one buffer, then checksum each slice of it
+    std::vector<char> body;
+    snapshotAppend(body, offsets, (n + 1) * sizeof(uint32_t));
+    snapshotAppend(body, targets, m * sizeof(uint32_t));
+    snapshotAppend(body, weights, m * sizeof(int32_t));
+    snapshotAppend(body, nameOffsets.data(), (n + 1) * sizeof(uint64_t));
+    for (uint64_t i = 0; i < n; i++) body.insert(body.end(), names[i].begin(), names[i].end());
+    body.resize(snapshotAlign(body.size()), 0);
+    snapshotAppend(body, table.data(), tableSize * sizeof(uint32_t));
+    if (dist != NULL && parent != NULL) {
+        snapshotAppend(body, dist, n * sizeof(int32_t));
+        snapshotAppend(body, parent, n * sizeof(int32_t));
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "GRAPHSNP", 8);
+    header.version = SNAPSHOT_VERSION;
+    header.flags = (dist != NULL && parent != NULL) ? SNAPSHOT_HAS_TREE : 0;
+    header.numNodes = n;
+    header.numEntries = m;
+    header.nameBytesSize = nameOffsets[n];
+    header.tableSize = tableSize;
+    header.maxWeight = maxWeight;
+    header.treeSource = header.flags ? treeSource : SNAPSHOT_NO_VERTEX;
+    uint64_t sizes[SNAPSHOT_SECTIONS];
+    snapshotSectionSizes(header, sizes);
+    size_t pos = 0;
+    for (int i = 0; i < SNAPSHOT_SECTIONS; i++) {
+        header.checksums[i] = snapshotChecksum(body.data() + pos, sizes[i]);
+        pos += sizes[i];
+    }
+
+    std::ofstream out(fileName.c_str(), std::ios::binary);
+    if (!out.is_open()) return false;
+    out.write((const char*)&header, sizeof(header));
+    out.write(body.data(), body.size());
+    return (bool)out;
+}
+
+// Read-only view of a mapped snapshot
+class GraphSnapshot {
+private:
+    const char* data;
+    size_t size;
+    SnapshotHeader header;
+    const uint32_t* offsets;
+    const uint32_t* targets;
+    const int* weights;
+    const uint64_t* nameOffsets;
+    const char* nameBytes;
+    const uint32_t* table;
+    const int* treeDist;
+    const int* treeParent;
+    std::string error;
+
+    void unmap() {
+        if (data != NULL) munmap((void*)data, size);
+        data = NULL;
+        size = 0;
+    }
+
+    bool fail(const std::string& message) {
+        error = message;
+        unmap();
+        return false;
+    }
+
+    GraphSnapshot(const GraphSnapshot&);
+    GraphSnapshot& operator=(const GraphSnapshot&);
+
+public:
+    GraphSnapshot() : data(NULL), size(0) {}
+
+    ~GraphSnapshot() {
+        unmap();
+    }
+
+    // Maps the file and checks the header and that the sections exactly
+    // fill it. With verifyChecksums every section is also hashed against
+    // the header, which reads the whole file.
+    bool load(const std::string& fileName, bool verifyChecksums = false) {
+        unmap();
+        int fd = open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) return fail("cannot open " + fileName);
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SnapshotHeader)) {
+            close(fd);
+            return fail("not a graph snapshot: " + fileName);
+        }
+        size = (size_t)info.st_size;
+        void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            size = 0;
+            return fail("cannot map " + fileName);
+        }
+        data = (const char*)mapped;
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, "GRAPHSNP", 8) != 0) return fail("not a graph snapshot: " + fileName);
+        if (header.version != SNAPSHOT_VERSION) return fail("unsupported snapshot version in " + fileName);
+
+        // No count can exceed the file size, which keeps the section sizes
+        // from overflowing; vertex ids must fit below SNAPSHOT_NO_VERTEX and
+        // the name table needs a free slot to end every probe
+        uint64_t n = header.numNodes, m = header.numEntries;
+        bool hasTree = (header.flags & SNAPSHOT_HAS_TREE) != 0;
+        if (n >= SNAPSHOT_NO_VERTEX || n > size || m > size || header.nameBytesSize > size ||
+            header.tableSize > size || header.tableSize <= n || (header.tableSize & (header.tableSize - 1)) != 0 ||
+            (hasTree && header.treeSource >= n)) {
+            return fail("corrupt snapshot header in " + fileName);
+        }
+        uint64_t sections[SNAPSHOT_SECTIONS];
+        snapshotSectionSizes(header, sections);
+        uint64_t expected = sizeof(SnapshotHeader);
+        for (int i = 0; i < SNAPSHOT_SECTIONS; i++) expected += sections[i];
+        if (expected != size) return fail("truncated or oversized snapshot: " + fileName);
+
+        size_t pos = sizeof(SnapshotHeader);
+        if (verifyChecksums) {
+            size_t section = pos;
+            for (int i = 0; i < SNAPSHOT_SECTIONS; i++) {
+                if (snapshotChecksum(data + section, sections[i]) != header.checksums[i]) {
+                    return fail("checksum mismatch in section " + std::to_string(i) + " of " + fileName);
+                }
+                section += sections[i];
+            }
+        }
+
+        offsets = (const uint32_t*)(data + pos);
+        pos += sections[0];
+        targets = (const uint32_t*)(data + pos);
+        pos += sections[1];
+        weights = (const int*)(data + pos);
+        pos += sections[2];
+        nameOffsets = (const uint64_t*)(data + pos);
+        pos += sections[3];
+        nameBytes = data + pos;
+        pos += sections[4];
+        table = (const uint32_t*)(data + pos);
+        pos += sections[5];
+        treeDist = treeParent = NULL;
+        if (hasTree) {
+            treeDist = (const int*)(data + pos);
+            treeParent = (const int*)(data + pos + snapshotAlign(n * sizeof(int32_t)));
+        }
+
+        // The ends of both offset arrays must match the section sizes
+        if (offsets[0] != 0 || offsets[n] != m || nameOffsets[0] != 0 || nameOffsets[n] != header.nameBytesSize) {
+            return fail("corrupt snapshot sections in " + fileName);
+        }
+        return true;
+    }
+
+    const std::string& getError() const { return error; }
+
+    uint32_t getNumNodes() const { return (uint32_t)header.numNodes; }
+    uint64_t getNumEntries() const { return header.numEntries; }
+    int getMaxWeight() const { return header.maxWeight; }
+
+    const uint32_t* getOffsets() const { return offsets; }
+    const uint32_t* getTargets() const { return targets; }
+    const int* getWeights() const { return weights; }
+
+    const char* nameData(uint32_t id) const { return nameBytes + nameOffsets[id]; }
+    size_t nameLength(uint32_t id) const { return (size_t)(nameOffsets[id + 1] - nameOffsets[id]); }
+
+    // Vertex id for a name, or SNAPSHOT_NO_VERTEX
+    uint32_t find(const char* name, size_t length) const {
+        uint64_t mask = header.tableSize - 1;
+        for (uint64_t slot = snapshotNameHash(name, length) & mask;; slot = (slot + 1) & mask) {
+            uint32_t id = table[slot];
+            if (id == SNAPSHOT_NO_VERTEX) return SNAPSHOT_NO_VERTEX;
+            if (nameLength(id) == length && memcmp(nameData(id), name, length) == 0) return id;
+        }
+    }
+
+    bool hasTree() const { return treeDist != NULL; }
+    uint32_t getTreeSource() const { return header.treeSource; }
+    const int* getTreeDist() const { return treeDist; }
+    const int* getTreeParent() const { return treeParent; }
+};
+
+#endif
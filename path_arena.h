@@ -0,0 +1,88 @@
+#ifndef PATH_ARENA_H
+#define PATH_ARENA_H
+
+// Path storage shared by B2 and B3. A PathView is a non-owning
+// (pointer, length) view of one path. The vertices themselves live in a
+// PathArena, a bump allocator over large blocks. A block is never resized,
+// so views stay valid until the arena is cleared. clear() keeps the
+// blocks, so after the first batch, a batch of the same size allocates
+// nothing.
+
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+template <class T>
+class PathView {
+private:
+    const T* items;
+    size_t length;
+
+public:
+    PathView() : items(NULL), length(0) {}
+    PathView(const T* items, size_t length) : items(items), length(length) {}
+
+    const T* begin() const { return items; }
+    const T* end() const { return items + length; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    const T& operator[](size_t i) const { return items[i]; }
+    const T& front() const { return items[0]; }
+    const T& back() const { return items[length - 1]; }
+};
+
+// Same vertices in the same order, wherever they are stored
+template <class T>
+inline bool operator==(const PathView<T>& a, const PathView<T>& b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+template <class T>
+inline bool operator!=(const PathView<T>& a, const PathView<T>& b) {
+    return !(a == b);
+}
+
+template <class T>
+class PathArena {
+private:
+    static const size_t BLOCK_SIZE = 1 << 16;  // items per block; longer paths get a block of their own
+
+    std::vector<std::vector<T> > blocks;
+    size_t current;  // block being filled
+    size_t used;     // items already handed out from it
+
+    PathArena(const PathArena&);
+    PathArena& operator=(const PathArena&);
+
+public:
+    PathArena() : current(0), used(0) {}
+
+    // Contiguous room for length items, filled in by the caller
+    T* allocate(size_t length) {
+        while (current < blocks.size() && used + length > blocks[current].size()) {
+            current++;
+            used = 0;
+        }
+        if (current == blocks.size()) blocks.push_back(std::vector<T>(std::max(BLOCK_SIZE, length)));
+        T* out = blocks[current].data() + used;
+        used += length;
+        return out;
+    }
+
+    PathView<T> copy(const T* items, size_t length) {
+        T* out = allocate(length);
+        std::copy(items, items + length, out);
+        return PathView<T>(out, length);
+    }
+
+    // Invalidates every view handed out so far; the blocks are kept
+    void clear() {
+        current = 0;
+        used = 0;
+    }
+};
+
+template <class T>
+const size_t PathArena<T>::BLOCK_SIZE;
+
+#endif